@@ -8,6 +8,7 @@
 #include "ast.h"
 #include "exceptions.h"
 #include "operator.h"
+#include "task_scheduler.h"
 
 // OperatorName
 std::ostream& OperatorName::print_to( std::ostream& os ) const {
@@ -22,10 +23,13 @@ std::ostream& NamedParameter::print_to( std::ostream& os ) const {
     return os << "{NamedVar} " << name;
 }
 NamedParameter * NamedParameter::clone() const {
-    return new NamedParameter{ name };
+    return new NamedParameter{ name, slot };
 }
-void NamedParameter::decompose( const Variable& var, VariableTable& table ) const {
-    table.insert( name.lexeme, std::move(var.clone()) );
+bool NamedParameter::try_decompose( const Variable& var, Frame& frame ) const {
+    return frame.bind( slot, var );
+}
+PatternKey NamedParameter::key() const {
+    return { PatternKey::any, 0 };
 }
 
 // RestrictedParameter
@@ -33,11 +37,13 @@ std::ostream& RestrictedParameter::print_to( std::ostream& os ) const {
     return os << "{{RestrictedVar} " << name << '}';
 }
 RestrictedParameter * RestrictedParameter::clone() const {
-    return new RestrictedParameter{ name };
+    return new RestrictedParameter{ name, slot };
+}
+bool RestrictedParameter::try_decompose( const Variable& var, Frame& frame ) const {
+    return !var.is_pair() && frame.bind( slot, var );
 }
-void RestrictedParameter::decompose( const Variable& var, VariableTable& table ) const {
-    if( var.first ) throw semantic_error( name.lexeme + " needs to be a number" );
-    table.insert( name.lexeme, std::move(var.clone()) );
+PatternKey RestrictedParameter::key() const {
+    return { PatternKey::number, 0 };
 }
 
 // NumericParameter
@@ -47,10 +53,12 @@ std::ostream& NumericParameter::print_to( std::ostream& os ) const {
 NumericParameter * NumericParameter::clone() const {
     return new NumericParameter{ name, value };
 }
-void NumericParameter::decompose( const Variable& var, VariableTable& ) const {
-    if( var.first ) throw semantic_error( name.lexeme + " needs to be a number" );
-    if( var.value != value ) throw semantic_error( "Unmatched value" );
+bool NumericParameter::try_decompose( const Variable& var, Frame& ) const {
     // NumericParameter is a mere matching Parameter.
+    return !var.is_pair() && var.value() == value;
+}
+PatternKey NumericParameter::key() const {
+    return { PatternKey::literal, value };
 }
 
 // PairParameter
@@ -60,9 +68,13 @@ std::ostream& PairParameter::print_to( std::ostream& os ) const {
 PairParameter * PairParameter::clone() const {
     return new PairParameter{ first->clone(), second->clone() };
 }
-void PairParameter::decompose( const Variable& var, VariableTable& table ) const {
-    first->decompose( var, table );
-    second->decompose( var, table );
+bool PairParameter::try_decompose( const Variable& var, Frame& frame ) const {
+    return var.is_pair() &&
+        first->try_decompose( var.first(), frame ) &&
+        second->try_decompose( var.second(), frame );
+}
+PatternKey PairParameter::key() const {
+    return { PatternKey::pair, 0 };
 }
 
 // PairBody
@@ -70,12 +82,18 @@ std::ostream& PairBody::print_to( std::ostream& os ) const {
     return os << "{{PairBody} " << *first << ", " << *second << '}';
 }
 PairBody * PairBody::clone() const {
-    return new PairBody{ first->clone(), second->clone() };
-}
-std::unique_ptr<Variable> PairBody::evaluate( const VariableTable& table ) const {
-    auto lptr = std::move( first->evaluate(table) );
-    auto rptr = std::move( second->evaluate(table) );
-    return std::make_unique<Variable>( std::move(lptr), std::move(rptr) );
+    auto ptr = new PairBody{ first->clone(), second->clone() };
+    ptr->fork = fork;
+    return ptr;
+}
+Variable PairBody::evaluate( const Frame& frame ) const {
+    if( fork && TaskScheduler::active ) {
+        auto pair = TaskScheduler::active->evaluate( *first, *second, frame );
+        return Variable( pair.first, pair.second );
+    }
+    auto lvar = first->evaluate(frame);
+    auto rvar = second->evaluate(frame);
+    return Variable( lvar, rvar );
     // step-by-step evaluation guarantees left-to-right evaluation.
 }
 
@@ -92,7 +110,7 @@ SequenceBody * SequenceBody::clone() const {
         ret->sequence.emplace_back( ptr->clone() );
     return ret;
 }
-std::unique_ptr<Variable> SequenceBody::evaluate( const VariableTable& ) const {
+Variable SequenceBody::evaluate( const Frame& ) const {
     throw std::logic_error( "SequenceBody::evaluate called" );
 }
 
@@ -103,7 +121,7 @@ std::ostream& TerminalBody::print_to( std::ostream& os ) const {
 TerminalBody * TerminalBody::clone() const {
     return new TerminalBody{ name };
 }
-std::unique_ptr<Variable> TerminalBody::evaluate( const VariableTable& ) const {
+Variable TerminalBody::evaluate( const Frame& ) const {
     throw std::logic_error( "TerminalBody::evaluate called" );
 }
 
@@ -112,10 +130,10 @@ std::ostream& VariableBody::print_to( std::ostream& os ) const {
     return os << "{VariableBody} " << name;
 }
 VariableBody * VariableBody::clone() const {
-    return new VariableBody{ name };
+    return new VariableBody{ name, slot };
 }
-std::unique_ptr<Variable> VariableBody::evaluate( const VariableTable& table ) const {
-    return table.retrieve(name);
+Variable VariableBody::evaluate( const Frame& frame ) const {
+    return frame[slot];
 }
 
 // NumericBody
@@ -125,8 +143,19 @@ std::ostream& NumericBody::print_to( std::ostream& os ) const {
 NumericBody * NumericBody::clone() const {
     return new NumericBody{ value };
 }
-std::unique_ptr<Variable> NumericBody::evaluate( const VariableTable& ) const {
-    return std::make_unique<Variable>( value );
+Variable NumericBody::evaluate( const Frame& ) const {
+    return Variable( value );
+}
+
+// ConstantBody
+std::ostream& ConstantBody::print_to( std::ostream& os ) const {
+    return os << "{ConstantBody} " << value;
+}
+ConstantBody * ConstantBody::clone() const {
+    return new ConstantBody{ value };
+}
+Variable ConstantBody::evaluate( const Frame& ) const {
+    return value;
 }
 
 // NullaryTreeBody
@@ -136,7 +165,8 @@ std::ostream& NullaryTreeBody::print_to( std::ostream& os ) const {
 NullaryTreeBody * NullaryTreeBody::clone() const {
     return new NullaryTreeBody{ op }; // note there is no 'clone'
 }
-std::unique_ptr<Variable> NullaryTreeBody::evaluate( const VariableTable& ) const {
+Variable NullaryTreeBody::evaluate( const Frame& ) const {
+    TaskScheduler::poll();
     return op->compute();
 }
 
@@ -147,8 +177,9 @@ std::ostream& UnaryTreeBody::print_to( std::ostream& os ) const {
 UnaryTreeBody * UnaryTreeBody::clone() const {
     return new UnaryTreeBody{ op, variable->clone() };
 }
-std::unique_ptr<Variable> UnaryTreeBody::evaluate( const VariableTable& table ) const {
-    return op->compute( variable->evaluate( table ) );
+Variable UnaryTreeBody::evaluate( const Frame& frame ) const {
+    TaskScheduler::poll();
+    return op->compute( variable->evaluate( frame ) );
 }
 
 // BinaryTreeBody
@@ -156,12 +187,19 @@ std::ostream& BinaryTreeBody::print_to( std::ostream& os ) const {
     return os << "{{BinaryTreeBody} " << *left << " " << op->name << " " << *right << " }";
 }
 BinaryTreeBody * BinaryTreeBody::clone() const {
-    return new BinaryTreeBody{ op, left->clone(), right->clone() };
-}
-std::unique_ptr<Variable> BinaryTreeBody::evaluate( const VariableTable& table ) const {
-    auto lptr = std::move( left->evaluate(table) );
-    auto rptr = std::move( right->evaluate(table) );
-    return op->compute( std::move(lptr), std::move(rptr) );
+    auto ptr = new BinaryTreeBody{ op, left->clone(), right->clone() };
+    ptr->fork = fork;
+    return ptr;
+}
+Variable BinaryTreeBody::evaluate( const Frame& frame ) const {
+    TaskScheduler::poll();
+    if( fork && TaskScheduler::active ) {
+        auto pair = TaskScheduler::active->evaluate( *left, *right, frame );
+        return op->compute( std::move(pair.first), std::move(pair.second) );
+    }
+    auto lvar = left->evaluate(frame);
+    auto rvar = right->evaluate(frame);
+    return op->compute( std::move(lvar), std::move(rvar) );
 }
 
 // IncludeCommand
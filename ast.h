@@ -59,59 +59,91 @@ struct OperatorName : public SignatureToken {
  *
  * After parsing, the validation of variables against the matching pattern
  * and the decomposition of valid variables in the existing names
- * is done by the method 'decompose'.
+ * is done by the method 'try_decompose'.
  * The inputs to this method are a Variable and a reference to a
- * VariableTable. If the Variable matches the pattern, the table
- * is populated with the respective parts of the Variable.
- * In the event of a failed match, an semantic_error is thrown.
+ * Frame. If the Variable matches the pattern, the frame is populated
+ * with the respective parts of the Variable, each in the slot that
+ * semantic analysis assigned to its name, and true is returned.
+ * In the event of a failed match, false is returned; the frame
+ * might have been partially populated.
+ *
+ * The method 'key' summarizes the values the pattern may accept,
+ * looking only at its top level. It is used to index the overloads
+ * of each operator (see overload_index.h).
  */
+struct PatternKey {
+    enum Kind {
+        any,     // NamedParameter
+        number,  // RestrictedParameter
+        literal, // NumericParameter; the number must be 'value'
+        pair,    // PairParameter
+    } kind;
+    long long value;
+};
+
 struct OperatorParameter : public SignatureToken {
+    /* Concrete type of the parameter; see OperatorBody::Kind. */
+    enum Kind { named, restricted, numeric, pair };
+    const Kind kind;
+
+    explicit OperatorParameter( Kind kind ) : kind( kind ) {}
     virtual ~OperatorParameter() = default;
-    virtual void decompose( const Variable&, VariableTable& ) const = 0;
+    virtual bool try_decompose( const Variable&, Frame& ) const = 0;
+    virtual PatternKey key() const = 0;
     virtual OperatorParameter * clone() const override = 0;
 };
 
 struct NamedParameter : public OperatorParameter {
-    NamedParameter() = default;
-    NamedParameter( auto&& t ) : name(AUX_FORWARD(t)) {}
+    NamedParameter() : OperatorParameter( named ) {}
+    NamedParameter( auto&& t, unsigned s = 0 ) :
+        OperatorParameter( named ), name(AUX_FORWARD(t)), slot(s) {}
     Token name;
+    unsigned slot = 0; // Assigned during semantic analysis.
     virtual std::ostream& print_to( std::ostream& ) const override;
-    virtual void decompose( const Variable&, VariableTable& ) const;
+    virtual bool try_decompose( const Variable&, Frame& ) const;
+    virtual PatternKey key() const;
     virtual NamedParameter * clone() const override;
 };
 
 struct RestrictedParameter : public OperatorParameter {
-    RestrictedParameter() = default;
-    RestrictedParameter( auto&& t ) : name(AUX_FORWARD(t)) {}
+    RestrictedParameter() : OperatorParameter( restricted ) {}
+    RestrictedParameter( auto&& t, unsigned s = 0 ) :
+        OperatorParameter( restricted ), name(AUX_FORWARD(t)), slot(s) {}
     Token name;
+    unsigned slot = 0; // Assigned during semantic analysis.
     virtual std::ostream& print_to( std::ostream& ) const override;
-    virtual void decompose( const Variable&, VariableTable& ) const;
+    virtual bool try_decompose( const Variable&, Frame& ) const;
+    virtual PatternKey key() const;
     virtual RestrictedParameter * clone() const override;
 };
 
 struct NumericParameter : public OperatorParameter {
-    NumericParameter() = default;
+    NumericParameter() : OperatorParameter( numeric ) {}
     NumericParameter( auto&& t, auto&& v ) :
+        OperatorParameter( numeric ),
         name(AUX_FORWARD(t)),
         value(AUX_FORWARD(v))
     {}
     Token name;
     unsigned value;
     virtual std::ostream& print_to( std::ostream& ) const override;
-    virtual void decompose( const Variable&, VariableTable& ) const;
+    virtual bool try_decompose( const Variable&, Frame& ) const;
+    virtual PatternKey key() const;
     virtual NumericParameter * clone() const override;
 };
 
 struct PairParameter : public OperatorParameter {
-    PairParameter() = default;
+    PairParameter() : OperatorParameter( pair ) {}
     PairParameter(auto&& first, auto&& second) :
+        OperatorParameter( pair ),
         first(AUX_FORWARD(first)),
         second(AUX_FORWARD(second))
     {}
     std::unique_ptr<OperatorParameter> first;
     std::unique_ptr<OperatorParameter> second;
     virtual std::ostream& print_to( std::ostream& ) const override;
-    virtual void decompose( const Variable&, VariableTable& ) const;
+    virtual bool try_decompose( const Variable&, Frame& ) const;
+    virtual PatternKey key() const;
     virtual PairParameter * clone() const override;
 };
 
@@ -134,62 +166,95 @@ struct PairParameter : public OperatorParameter {
  * variable is present.
  *
  * Calling SequenceBody::evaluate or TerminalBody::evaluate raises an exception.
+ *
+ * Each node is tagged with its concrete type, 'kind', so that the passes
+ * over the tree may select the code for each node with a switch, instead
+ * of typeid or chains of dynamic_cast. The same goes for the classes
+ * below OperatorParameter and Statement.
  */
 struct OperatorBody : public Printable {
-    virtual std::unique_ptr<Variable> evaluate( const VariableTable& ) const = 0;
+    enum Kind {
+        pair, sequence, terminal,       // PairBody, SequenceBody, TerminalBody
+        variable, numeric, constant,    // VariableBody, NumericBody, ConstantBody
+        nullary, unary, binary,         // NullaryTreeBody, UnaryTreeBody, BinaryTreeBody
+        native,                         // NativeOperation (see native.h)
+    };
+    const Kind kind;
+
+    explicit OperatorBody( Kind kind ) : kind( kind ) {}
+    virtual Variable evaluate( const Frame& ) const = 0;
     virtual ~OperatorBody() = default;
     virtual OperatorBody * clone() const override = 0;
 };
 
 struct PairBody : public OperatorBody {
-    PairBody() = default;
+    PairBody() : OperatorBody( pair ) {}
     PairBody(auto&& first, auto&& second) :
+        OperatorBody( pair ),
         first(AUX_FORWARD(first)),
         second(AUX_FORWARD(second))
     {}
     std::unique_ptr<OperatorBody> first;
     std::unique_ptr<OperatorBody> second;
+    /* Set by markForks (see task_scheduler.h). */
+    bool fork = false;
     virtual std::ostream& print_to( std::ostream& ) const override;
-    virtual std::unique_ptr<Variable> evaluate( const VariableTable & ) const;
+    virtual Variable evaluate( const Frame & ) const;
     virtual PairBody * clone() const override;
 };
 
 struct SequenceBody : public OperatorBody {
+    SequenceBody() : OperatorBody( OperatorBody::sequence ) {}
     std::vector< std::unique_ptr<OperatorBody> > sequence;
-    virtual std::unique_ptr<Variable> evaluate( const VariableTable & ) const;
+    virtual Variable evaluate( const Frame & ) const;
     virtual std::ostream& print_to( std::ostream& ) const override;
     virtual SequenceBody * clone() const override;
 };
 
 struct TerminalBody : public OperatorBody {
-    TerminalBody() = default;
-    TerminalBody( auto&& t ) : name(AUX_FORWARD(t)) {}
+    TerminalBody() : OperatorBody( terminal ) {}
+    TerminalBody( auto&& t ) : OperatorBody( terminal ), name(AUX_FORWARD(t)) {}
     Token name;
-    virtual std::unique_ptr<Variable> evaluate( const VariableTable & ) const;
+    virtual Variable evaluate( const Frame & ) const;
     virtual std::ostream& print_to( std::ostream& ) const override;
     virtual TerminalBody * clone() const override;
 };
 
 /* These two structures are generated from TerminalBody
- * during semantic analysis. */
+ * during semantic analysis.
+ * The name of a VariableBody is kept only for printing; evaluation
+ * reads the slot of the enclosing overload's frame. */
 struct VariableBody : public OperatorBody {
-    VariableBody() = default;
-    VariableBody( auto&& n ) : name(AUX_FORWARD(n)) {}
-    std::string name;
-    virtual std::unique_ptr<Variable> evaluate( const VariableTable & ) const;
+    VariableBody() : OperatorBody( variable ) {}
+    VariableBody( auto&& n, unsigned s ) :
+        OperatorBody( variable ), name(AUX_FORWARD(n)), slot(s) {}
+    Name name;
+    unsigned slot;
+    virtual Variable evaluate( const Frame & ) const;
     virtual std::ostream& print_to( std::ostream& ) const override;
     virtual VariableBody * clone() const override;
 };
 
 struct NumericBody : public OperatorBody {
-    NumericBody() = default;
-    NumericBody( auto&& v ) : value(AUX_FORWARD(v)) {}
+    NumericBody() : OperatorBody( numeric ) {}
+    NumericBody( auto&& v ) : OperatorBody( numeric ), value(AUX_FORWARD(v)) {}
     long long value;
-    virtual std::unique_ptr<Variable> evaluate( const VariableTable & ) const;
+    virtual Variable evaluate( const Frame & ) const;
     virtual std::ostream& print_to( std::ostream& ) const override;
     virtual NumericBody * clone() const override;
 };
 
+/* Value of a subexpression without variables, computed ahead of
+ * time by foldConstants (see constant_folding.h). */
+struct ConstantBody : public OperatorBody {
+    ConstantBody() : OperatorBody( constant ) {}
+    ConstantBody( auto&& v ) : OperatorBody( constant ), value(AUX_FORWARD(v)) {}
+    Variable value;
+    virtual Variable evaluate( const Frame & ) const;
+    virtual std::ostream& print_to( std::ostream& ) const override;
+    virtual ConstantBody * clone() const override;
+};
+
 /* These structures are computed by the semantic analyzer.
  * Note that there is no need to differentiate between prefix
  * and postfix unary operators because all the semantic analysis
@@ -199,40 +264,45 @@ struct TreeNodeBody : public OperatorBody {
      * Since each pointer points to a different object type,
      * it is better to mantain the pointer in each derived class
      * rendering this class empty. */
-    virtual std::unique_ptr<Variable> evaluate( const VariableTable & ) const = 0;
+    explicit TreeNodeBody( Kind kind ) : OperatorBody( kind ) {}
+    virtual Variable evaluate( const Frame & ) const = 0;
     virtual TreeNodeBody * clone() const override = 0;
 };
 
 struct NullaryTreeBody : public TreeNodeBody {
-    NullaryTreeBody() = default;
-    NullaryTreeBody( auto&& op ) : op(AUX_FORWARD(op)) {}
+    NullaryTreeBody() : TreeNodeBody( nullary ) {}
+    NullaryTreeBody( auto&& op ) : TreeNodeBody( nullary ), op(AUX_FORWARD(op)) {}
     const NullaryOperator * op;
-    virtual std::unique_ptr<Variable> evaluate( const VariableTable & ) const;
+    virtual Variable evaluate( const Frame & ) const;
     virtual std::ostream& print_to( std::ostream& ) const override;
     virtual NullaryTreeBody * clone() const override;
 };
 struct UnaryTreeBody : public TreeNodeBody {
-    UnaryTreeBody() = default;
+    UnaryTreeBody() : TreeNodeBody( unary ) {}
     UnaryTreeBody( auto&& op, auto&& variable ) :
+        TreeNodeBody( unary ),
         op(AUX_FORWARD(op)),
         variable(AUX_FORWARD(variable))
     {}
     const UnaryOperator * op;
     std::unique_ptr<OperatorBody> variable;
-    virtual std::unique_ptr<Variable> evaluate( const VariableTable & ) const;
+    virtual Variable evaluate( const Frame & ) const;
     virtual std::ostream& print_to( std::ostream& ) const override;
     virtual UnaryTreeBody * clone() const override;
 };
 struct BinaryTreeBody : public TreeNodeBody {
-    BinaryTreeBody() = default;
+    BinaryTreeBody() : TreeNodeBody( binary ) {}
     BinaryTreeBody( auto&& op, auto&& l, auto&& r ) :
+        TreeNodeBody( binary ),
         op(AUX_FORWARD(op)),
         left(AUX_FORWARD(l)),
         right(AUX_FORWARD(r))
     {}
     const BinaryOperator * op;
     std::unique_ptr<OperatorBody> left, right;
-    virtual std::unique_ptr<Variable> evaluate( const VariableTable & ) const;
+    /* Set by markForks (see task_scheduler.h). */
+    bool fork = false;
+    virtual Variable evaluate( const Frame & ) const;
     virtual std::ostream& print_to( std::ostream& ) const override;
     virtual BinaryTreeBody * clone() const override;
 };
@@ -241,27 +311,35 @@ struct BinaryTreeBody : public TreeNodeBody {
  * There are three statements: IncludeCommand, CategoryDefinition
  * and OperatorDefinition. */
 struct Statement : public Printable {
+    /* Concrete type of the statement; see OperatorBody::Kind.
+     * OperatorOverload (see operator.h) replaces the
+     * OperatorDefinition after semantic analysis. */
+    enum Kind { include, category, definition, overload };
+    const Kind kind;
+
+    explicit Statement( Kind kind ) : kind( kind ) {}
     virtual ~Statement() = default;
     virtual Statement * clone() const override = 0;
 };
 
 struct IncludeCommand : public Statement {
-    IncludeCommand() = default;
-    IncludeCommand( auto&& n ) : filename(AUX_FORWARD(n)) {}
+    IncludeCommand() : Statement( include ) {}
+    IncludeCommand( auto&& n ) : Statement( include ), filename(AUX_FORWARD(n)) {}
     Token filename;
     virtual std::ostream& print_to( std::ostream& ) const override;
     virtual IncludeCommand * clone() const override;
 };
 
 struct CategoryDefinition : public Statement {
-    CategoryDefinition() = default;
-    CategoryDefinition( auto&& n ) : name(AUX_FORWARD(n)) {}
+    CategoryDefinition() : Statement( category ) {}
+    CategoryDefinition( auto&& n ) : Statement( category ), name(AUX_FORWARD(n)) {}
     Token name;
     virtual std::ostream& print_to( std::ostream& ) const override;
     virtual CategoryDefinition * clone() const override;
 };
 
 struct OperatorDefinition : public Statement {
+    OperatorDefinition() : Statement( definition ) {}
     unsigned priority;
     std::string format; // "F", "FX", "FY", "XFX", "YFX" etc.
     std::vector< std::unique_ptr<SignatureToken> > names;
@@ -0,0 +1,219 @@
+/* bytecode.cpp
+ * Implementation of bytecode.h
+ */
+#include <unordered_map>
+#include "bytecode.h"
+#include "exceptions.h"
+
+namespace {
+
+struct Compiler {
+    Bytecode program;
+    std::unordered_map<const Symbol *, unsigned> ids;
+    struct Hash {
+        std::size_t operator()( const Variable & v ) const { return v.hash(); }
+    };
+    std::unordered_map<Variable, unsigned, Hash> value_ids;
+    std::unordered_map<const NativeBinaryNumericOperation *, unsigned> arithmetic_ids;
+    std::vector<unsigned> pending; // Operators registered but not compiled yet.
+
+    /* State of the body being compiled.
+     * While compiling, the registers of temporaries and constants
+     * are tagged, since their final numbers depend on the number
+     * of temporaries; they are fixed at the end of the body. */
+    static const unsigned temporary = 1u << 30;
+    static const unsigned constant = 1u << 31;
+    struct Tagged {
+        Instruction::Opcode opcode;
+        unsigned dest, left, right, operand;
+    };
+    std::vector<Tagged> body_code;
+    std::vector<unsigned> body_constants;
+    std::unordered_map<unsigned, unsigned> constant_registers;
+    unsigned depth;     // Temporaries in use at this point of the body.
+    unsigned max_depth; // Temporaries needed by the body.
+
+    /* Returns the index of the operator in program.operators,
+     * registering it for compilation if needed. */
+    unsigned id( const Symbol * op, unsigned arity ) {
+        auto pair = ids.emplace( op, program.operators.size() );
+        if( pair.second ) {
+            program.operators.push_back( CompiledOperator{ arity, op, {} } );
+            pending.push_back( pair.first->second );
+        }
+        return pair.first->second;
+    }
+
+    unsigned value( const Variable & value ) {
+        auto pair = value_ids.emplace( value, program.values.size() );
+        if( pair.second )
+            program.values.push_back( value );
+        return pair.first->second;
+    }
+
+    /* Returns the native operation that is the only overload of
+     * the operator, or nullptr if there is none. */
+    static const NativeBinaryNumericOperation * arithmetic( const BinaryOperator & op ) {
+        if( op.overloads.size() != 1 )
+            return nullptr;
+        return dynamic_cast<const NativeBinaryNumericOperation *>( op.overloads[0]->body.get() );
+    }
+
+    unsigned arithmetic_id( const NativeBinaryNumericOperation * native ) {
+        auto pair = arithmetic_ids.emplace( native, program.arithmetic.size() );
+        if( pair.second )
+            program.arithmetic.push_back( native );
+        return pair.first->second;
+    }
+
+    /* Returns the (tagged) register of the constant. */
+    unsigned constant_register( const Variable & constant_value ) {
+        auto pair = constant_registers.emplace( value(constant_value), body_constants.size() );
+        if( pair.second )
+            body_constants.push_back( pair.first->first );
+        return constant | pair.first->second;
+    }
+
+    /* Returns the (tagged) register that holds the value of the body,
+     * emitting the instructions needed to compute it. */
+    unsigned operand( const OperatorBody & body ) {
+        switch( body.kind ) {
+            case OperatorBody::numeric:
+                return constant_register( Variable(static_cast<const NumericBody &>( body ).value) );
+            case OperatorBody::constant:
+                return constant_register( static_cast<const ConstantBody &>( body ).value );
+            case OperatorBody::variable:
+                return static_cast<const VariableBody &>( body ).slot;
+            default:
+                break;
+        }
+
+        unsigned saved = depth;
+        Tagged instruction = compute( body );
+        /* The operands are read before the result is stored,
+         * so the temporaries of the operands can be reused. */
+        depth = saved;
+        instruction.dest = depth++;
+        if( depth > max_depth )
+            max_depth = depth;
+        body_code.push_back( instruction );
+        return temporary | instruction.dest;
+    }
+
+    /* Compiles the operands of the body, and returns the instruction
+     * that computes the body from them, without destination. */
+    Tagged compute( const OperatorBody & body ) {
+        switch( body.kind ) {
+            case OperatorBody::pair: {
+                auto & pair = static_cast<const PairBody &>( body );
+                unsigned left = operand( *pair.first );
+                unsigned right = operand( *pair.second );
+                return Tagged{ Instruction::pair, 0, left, right, 0 };
+            }
+            case OperatorBody::nullary:
+                return Tagged{ Instruction::call0, 0, 0, 0,
+                    id( static_cast<const NullaryTreeBody &>( body ).op, 0 ) };
+            case OperatorBody::unary: {
+                auto & tree = static_cast<const UnaryTreeBody &>( body );
+                unsigned left = operand( *tree.variable );
+                return Tagged{ Instruction::call1, 0, left, 0, id( tree.op, 1 ) };
+            }
+            case OperatorBody::binary: {
+                auto & tree = static_cast<const BinaryTreeBody &>( body );
+                unsigned left = operand( *tree.left );
+                unsigned right = operand( *tree.right );
+                if( auto native = arithmetic( *tree.op ) )
+                    return Tagged{ Instruction::apply, 0, left, right, arithmetic_id( native ) };
+                return Tagged{ Instruction::call2, 0, left, right, id( tree.op, 2 ) };
+            }
+            default:
+                program.natives.push_back( &body );
+                return Tagged{ Instruction::native, 0, 0, 0, unsigned(program.natives.size() - 1) };
+        }
+    }
+
+    CompiledBody compile_body( const OperatorBody & body, unsigned slots ) {
+        body_code.clear();
+        body_constants.clear();
+        constant_registers.clear();
+        depth = max_depth = 0;
+
+        if( body.kind == OperatorBody::numeric ||
+            body.kind == OperatorBody::constant ||
+            body.kind == OperatorBody::variable )
+            body_code.push_back( Tagged{ Instruction::ret, Instruction::result, operand( body ), 0, 0 } );
+        else {
+            Tagged instruction = compute( body );
+            instruction.dest = Instruction::result;
+            body_code.push_back( instruction );
+        }
+
+        CompiledBody compiled{
+            unsigned(program.code.size()),
+            slots,
+            max_depth,
+            unsigned(program.constants.size()),
+            unsigned(body_constants.size())
+        };
+        if( compiled.registers() >= Instruction::result )
+            throw semantic_error( "Operator body too large" );
+
+        auto resolve = [&]( unsigned reg ) -> unsigned short {
+            if( reg & constant )
+                return slots + max_depth + (reg & ~constant);
+            if( reg & temporary )
+                return slots + (reg & ~temporary);
+            return reg;
+        };
+        for( const Tagged & t : body_code )
+            program.code.push_back( Instruction{
+                    t.opcode,
+                    static_cast<unsigned short>( t.dest ),
+                    resolve( t.left ),
+                    resolve( t.right ),
+                    t.operand
+                } );
+        program.constants.insert( program.constants.end(),
+                body_constants.begin(), body_constants.end() );
+        return compiled;
+    }
+
+    template< typename Operator >
+    void compile_overloads( unsigned index ) {
+        auto op = static_cast<const Operator *>( program.operators[index].op );
+        std::vector<CompiledBody> bodies;
+        for( const auto & overload : op->overloads )
+            bodies.push_back( compile_body( *overload->body, overload->frame_size ) );
+        program.operators[index].bodies = std::move( bodies );
+    }
+
+    void compile_pending() {
+        while( !pending.empty() ) {
+            unsigned index = pending.back();
+            pending.pop_back();
+            switch( program.operators[index].arity ) {
+                case 0: compile_overloads<NullaryOperator>( index ); break;
+                case 1: compile_overloads<UnaryOperator>( index ); break;
+                case 2: compile_overloads<BinaryOperator>( index ); break;
+            }
+        }
+    }
+};
+
+} // anonymous namespace
+
+Bytecode compileProgram( const NullaryOperator & entry ) {
+    Compiler compiler;
+    compiler.id( &entry, 0 );
+    compiler.compile_pending();
+    return std::move( compiler.program );
+}
+
+Bytecode compileExpression( const OperatorBody & body ) {
+    Compiler compiler;
+    compiler.program.operators.push_back( CompiledOperator{ 0, nullptr, {} } );
+    CompiledBody compiled = compiler.compile_body( body, 0 );
+    compiler.program.operators[0].bodies.push_back( compiled );
+    compiler.compile_pending();
+    return std::move( compiler.program );
+}
@@ -0,0 +1,109 @@
+/* bytecode.h
+ * Linear representation of the operator bodies, executed by the
+ * VirtualMachine (see virtual_machine.h).
+ *
+ * Each overload body, after semantic analysis, is translated to a
+ * sequence of instructions for a register machine. The registers of
+ * a body are the slots of its Frame, laid out as follows:
+ *  - first, the variables bound by the pattern (frame_size slots);
+ *  - then, the temporaries, that hold the intermediate results;
+ *  - last, the constants used in the body: numbers, and the values
+ *    computed by foldConstants (see constant_folding.h).
+ *
+ * Each instruction reads its operands from the registers and stores
+ * its result in a temporary, or returns it if 'dest' is
+ * Instruction::result. For instance, the body
+ *
+ *  X + {7, Y}
+ *
+ * where X and Y are in the slots 0 and 1 is compiled to
+ *
+ *  pair t0, r3, r1
+ *  call2 result, +, r0, r2
+ *
+ * where r2 is the temporary t0 and r3 is the constant 7.
+ *
+ * Operators, constants and native bodies are referenced by their position
+ * in the tables of the Bytecode, and the code of each overload by its
+ * offset in 'code', so the instructions themselves hold no pointers.
+ *
+ * Overload selection is not compiled: the virtual machine uses the
+ * patterns and the index of the original operators.
+ */
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <vector>
+#include "ast.h"
+#include "native.h"
+#include "operator.h"
+
+struct Instruction {
+    enum Opcode : unsigned char {
+        pair,   // {left, right}
+        call0,  // operators[operand]
+        call1,  // operators[operand] applied to left
+        call2,  // operators[operand] applied to left and right
+        native, // natives[operand]->evaluate( frame )
+        apply,  // arithmetic[operand]->apply on the numbers left and right
+        ret,    // Returns left; 'dest' is always 'result'.
+    } opcode;
+    unsigned short dest; // Index of the temporary, or 'result'.
+    unsigned short left, right;
+    unsigned operand;
+
+    /* Value of 'dest' that makes the instruction return its result. */
+    static const unsigned short result = 0xFFFF;
+};
+
+/* Location of the code of an overload body, and its registers. */
+struct CompiledBody {
+    unsigned entry;          // Offset of the first instruction in 'code'.
+    unsigned slots;          // Registers bound by the pattern.
+    unsigned temporaries;    // Registers that follow the slots.
+    unsigned constants;      // Offset of its constants in 'constants'.
+    unsigned constant_count; // Registers that follow the temporaries.
+
+    unsigned registers() const { return slots + temporaries + constant_count; }
+};
+
+/* An operator referenced by some call instruction.
+ * 'op' is a NullaryOperator, an UnaryOperator or a BinaryOperator,
+ * according to the arity. */
+struct CompiledOperator {
+    unsigned arity;
+    const Symbol * op;
+    std::vector<CompiledBody> bodies; // One for each overload.
+};
+
+struct Bytecode {
+    std::vector<Instruction> code;
+    std::vector<Variable> values;
+
+    /* Constants of the bodies, as indices in 'values'. */
+    std::vector<unsigned> constants;
+
+    /* Bodies that have no bytecode counterpart, like the native
+     * operations; they are evaluated by the tree walker. */
+    std::vector<const OperatorBody *> natives;
+
+    /* Operators whose only overload is a binary numeric native; calls
+     * to them are compiled to 'apply' instead of 'call2'. */
+    std::vector<const NativeBinaryNumericOperation *> arithmetic;
+
+    /* operators[0] is the entry point of the program. */
+    std::vector<CompiledOperator> operators;
+};
+
+/* Compiles the body of every overload of the operator, and of
+ * every operator reachable from it.
+ * Throws semantic_error if some body needs more registers than
+ * an instruction can address. */
+Bytecode compileProgram( const NullaryOperator & entry );
+
+/* Compiles the expression, and every operator reachable from it.
+ * The entry point has a single body, the expression, and its 'op'
+ * is null. The expression shall have no variables. */
+Bytecode compileExpression( const OperatorBody & );
+
+#endif // BYTECODE_H
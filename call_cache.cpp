@@ -0,0 +1,89 @@
+/* call_cache.cpp
+ * Implementation of call_cache.h
+ */
+#include <cstdint>
+#include <ostream>
+#include "call_cache.h"
+
+/* Each entry is stored in a list node and indexed by a hash node;
+ * we also account for the bucket pointer. */
+const std::size_t CallCache::entry_size =
+    sizeof(std::pair<Key, Variable>) + 2 * sizeof(void *) + // list node
+    sizeof(std::pair<const Key *, void *>) + 2 * sizeof(void *) + // hash node
+    sizeof(void *); // bucket
+
+CallCache * CallCache::active = nullptr;
+
+namespace {
+    void clear_active() {
+        if( CallCache::active )
+            CallCache::active->clear();
+    }
+} // anonymous namespace
+
+CallCache::CallCache( std::size_t limit ) :
+    limit( limit )
+{
+    active = this;
+    VariablePool::on_release = clear_active;
+}
+
+CallCache::~CallCache() {
+    if( active == this ) {
+        active = nullptr;
+        VariablePool::on_release = nullptr;
+    }
+}
+
+std::size_t CallCache::KeyHash::operator()( const Key * key ) const {
+    std::size_t h = Variable::mix( reinterpret_cast<std::uintptr_t>(key->op) );
+    h = Variable::mix( h ^ key->left.hash() );
+    if( key->right )
+        h = Variable::mix( h ^ key->right.hash() );
+    return h;
+}
+
+const Variable * CallCache::find( const Key& key ) {
+    auto pair = counters.emplace( key.op, Counters() );
+    if( pair.second )
+        operators.push_back( key.op );
+    Counters & counter = pair.first->second;
+
+    auto it = index.find( &key );
+    if( it == index.end() ) {
+        ++counter.misses;
+        return nullptr;
+    }
+    ++counter.hits;
+    entries.splice( entries.begin(), entries, it->second );
+    return &it->second->second;
+}
+
+void CallCache::insert( Key&& key, const Variable& result ) {
+    if( limit < entry_size )
+        return;
+    /* The result might have been cached by a recursive call
+     * with the same arguments; keep the existing entry. */
+    if( index.count( &key ) != 0 )
+        return;
+
+    while( (entries.size() + 1) * entry_size > limit ) {
+        index.erase( &entries.back().first );
+        entries.pop_back();
+    }
+    entries.emplace_front( std::move(key), result );
+    index.emplace( &entries.front().first, entries.begin() );
+}
+
+void CallCache::clear() {
+    index.clear();
+    entries.clear();
+}
+
+void CallCache::report( std::ostream& os ) const {
+    for( const Symbol * op : operators ) {
+        const Counters & counter = counters.at( op );
+        os << op->name << ": " << counter.hits << " hits, "
+           << counter.misses << " misses\n";
+    }
+}
@@ -0,0 +1,115 @@
+/* call_cache.h
+ * Memoization of operator calls.
+ *
+ * Operators have no side effects, so the result of a call depends
+ * only on the operator and on its arguments. When a CallCache is
+ * active, UnaryOperator::compute and BinaryOperator::compute consult
+ * it before evaluating, and record their results after.
+ *
+ * Since variables are hash-consed, the key of a call is merely the
+ * operator and the handles of its arguments; the cache keeps those
+ * handles (and the result) alive while the entry exists.
+ *
+ * The memory used by the entries is bounded by a limit given at
+ * construction; the least recently used entries are evicted first.
+ * The limit accounts for the entries themselves, not for the cells of
+ * the variables they hold, which are usually shared with the program.
+ *
+ * Entries may refer to cells from the active VariablePool, so the
+ * cache is cleared whenever a pool is released.
+ *
+ * Calls that fail (that is, raise semantic_error) are not cached.
+ */
+#ifndef CALL_CACHE_H
+#define CALL_CACHE_H
+
+#include <cstddef>
+#include <iosfwd>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "symbol.h"
+#include "variable.h"
+
+class CallCache {
+    struct Key {
+        const Symbol * op;
+        Variable left, right; // 'right' is null for unary operators.
+    };
+    struct KeyHash {
+        std::size_t operator()( const Key * ) const;
+    };
+    struct KeyEqual {
+        bool operator()( const Key * lhs, const Key * rhs ) const {
+            return lhs->op == rhs->op && lhs->left == rhs->left && lhs->right == rhs->right;
+        }
+    };
+    struct Counters {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+    };
+
+    /* Entries, the most recently used first. */
+    std::list<std::pair<Key, Variable>> entries;
+    std::unordered_map<const Key *, decltype(entries)::iterator, KeyHash, KeyEqual> index;
+    std::unordered_map<const Symbol *, Counters> counters;
+    std::vector<const Symbol *> operators; // in order of first call
+    std::size_t limit;
+
+    const Variable * find( const Key& );
+    void insert( Key&&, const Variable& result );
+
+public:
+    /* Approximate memory used by each entry. */
+    static const std::size_t entry_size;
+
+    /* The cache consulted by the operators, or nullptr if
+     * memoization is disabled. */
+    static CallCache * active;
+
+    /* Constructs an empty cache and makes it the active one.
+     * 'limit' is the memory, in bytes, the entries may use. */
+    explicit CallCache( std::size_t limit );
+    ~CallCache();
+
+    CallCache( const CallCache& ) = delete;
+    CallCache& operator=( const CallCache& ) = delete;
+
+    /* Returns the cached result of op(left, right) if present;
+     * otherwise, computes it with 'compute' and caches it. */
+    template< typename Compute >
+    Variable memoize( const Symbol& op, const Variable& left,
+            const Variable& right, Compute&& compute )
+    {
+        Key key{ &op, left, right };
+        if( const Variable * result = find( key ) )
+            return *result;
+        Variable result = compute();
+        insert( std::move(key), result );
+        return result;
+    }
+
+    /* The two halves of memoize, for evaluators that do not compute
+     * the call within a function (see virtual_machine.h).
+     * 'lookup' returns nullptr if op(left, right) is not cached. */
+    const Variable * lookup( const Symbol& op, const Variable& left, const Variable& right ) {
+        return find( Key{ &op, left, right } );
+    }
+    void record( const Symbol& op, const Variable& left,
+            const Variable& right, const Variable& result )
+    {
+        insert( Key{ &op, left, right }, result );
+    }
+
+    /* Drops every entry; the counters are kept. */
+    void clear();
+
+    /* Number of entries currently stored. */
+    std::size_t size() const { return entries.size(); }
+
+    /* Prints the hits and misses of each operator called so far. */
+    void report( std::ostream& ) const;
+};
+
+#endif // CALL_CACHE_H
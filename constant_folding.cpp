@@ -0,0 +1,150 @@
+/* constant_folding.cpp
+ * Implementation of constant_folding.h
+ */
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "bytecode.h"
+#include "constant_folding.h"
+#include "exceptions.h"
+#include "virtual_machine.h"
+
+namespace {
+
+struct Folder {
+    std::size_t budget;
+    std::unordered_set<const Symbol *> visited;
+    struct Pending {
+        const Symbol * op;
+        unsigned arity;
+        bool keep_root; // Whether to leave the roots of the bodies unevaluated.
+    };
+    std::vector<Pending> pending;
+
+    void visit( const Symbol * op, unsigned arity, bool keep_root = false ) {
+        if( visited.insert( op ).second )
+            pending.push_back( Pending{ op, arity, keep_root } );
+    }
+
+    /* Returns the value of a body that is a constant. */
+    static Variable value( const OperatorBody & body ) {
+        if( body.kind == OperatorBody::numeric )
+            return Variable( static_cast<const NumericBody &>( body ).value );
+        return static_cast<const ConstantBody &>( body ).value;
+    }
+
+    /* Replaces the body by its value, if it can be computed within the budget. */
+    bool evaluate( std::unique_ptr<OperatorBody> & body ) {
+        try {
+            Bytecode program = compileExpression( *body );
+            VariablePool pool;
+            Variable result = pool.copy_out( VirtualMachine( program, budget ).run() );
+            body = std::make_unique<ConstantBody>( std::move(result) );
+            return true;
+        } catch( semantic_error & ) {
+            // The expression fails; it will fail again when run.
+        } catch( budget_exceeded & ) {
+            // Left to be computed when run.
+        }
+        return false;
+    }
+
+    /* Folds the closed subexpressions of the body, from the leaves up.
+     * Returns true if the body is a constant afterwards. */
+    bool fold( std::unique_ptr<OperatorBody> & body ) {
+        switch( body->kind ) {
+            case OperatorBody::numeric:
+            case OperatorBody::constant:
+                return true;
+            case OperatorBody::pair: {
+                auto & pair = static_cast<PairBody &>( *body );
+                bool first = fold( pair.first );
+                bool second = fold( pair.second );
+                if( !first || !second )
+                    return false;
+                body = std::make_unique<ConstantBody>(
+                        Variable( value(*pair.first), value(*pair.second) ) );
+                return true;
+            }
+            case OperatorBody::nullary:
+                visit( static_cast<NullaryTreeBody &>( *body ).op, 0 );
+                return evaluate( body );
+            case OperatorBody::unary: {
+                auto & tree = static_cast<UnaryTreeBody &>( *body );
+                visit( tree.op, 1 );
+                return fold( tree.variable ) && evaluate( body );
+            }
+            case OperatorBody::binary: {
+                auto & tree = static_cast<BinaryTreeBody &>( *body );
+                visit( tree.op, 2 );
+                bool left = fold( tree.left );
+                bool right = fold( tree.right );
+                return left && right && evaluate( body );
+            }
+            default:
+                return false; // Variables and native operations.
+        }
+    }
+
+    /* Folds the subexpressions of the body, but not the body itself.
+     * The body of the entry point is the whole program; evaluating it
+     * would run the program during the analysis. Pairs are looked through,
+     * and so are the bodies of the nullary operators called from here. */
+    void fold_operands( std::unique_ptr<OperatorBody> & body ) {
+        switch( body->kind ) {
+            case OperatorBody::pair: {
+                auto & pair = static_cast<PairBody &>( *body );
+                fold_operands( pair.first );
+                fold_operands( pair.second );
+                return;
+            }
+            case OperatorBody::nullary:
+                visit( static_cast<NullaryTreeBody &>( *body ).op, 0, true );
+                return;
+            case OperatorBody::unary: {
+                auto & tree = static_cast<UnaryTreeBody &>( *body );
+                visit( tree.op, 1 );
+                fold( tree.variable );
+                return;
+            }
+            case OperatorBody::binary: {
+                auto & tree = static_cast<BinaryTreeBody &>( *body );
+                visit( tree.op, 2 );
+                fold( tree.left );
+                fold( tree.right );
+                return;
+            }
+            default:
+                return;
+        }
+    }
+
+    template< typename Operator >
+    void fold_overloads( const Symbol * symbol, bool keep_root ) {
+        for( const auto & overload : static_cast<const Operator *>( symbol )->overloads )
+            if( keep_root )
+                fold_operands( overload->body );
+            else
+                fold( overload->body );
+    }
+
+    void fold_pending() {
+        while( !pending.empty() ) {
+            Pending next = pending.back();
+            pending.pop_back();
+            switch( next.arity ) {
+                case 0: fold_overloads<NullaryOperator>( next.op, next.keep_root ); break;
+                case 1: fold_overloads<UnaryOperator>( next.op, next.keep_root ); break;
+                case 2: fold_overloads<BinaryOperator>( next.op, next.keep_root ); break;
+            }
+        }
+    }
+};
+
+} // anonymous namespace
+
+void foldConstants( const NullaryOperator & entry, std::size_t budget ) {
+    Folder folder{ budget, {}, {} };
+    folder.visit( &entry, 0, true );
+    folder.fold_pending();
+}
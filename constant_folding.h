@@ -0,0 +1,32 @@
+/* constant_folding.h
+ * Evaluation, ahead of time, of the subexpressions that have no variables.
+ *
+ * A subexpression like '2 ^ 3 == 8' evaluates to the same value every
+ * time its body runs. After semantic analysis, foldConstants evaluates
+ * such subexpressions once, with the virtual machine, and replaces them
+ * by ConstantBody nodes.
+ *
+ * Since the overloads are selected at runtime among every overload of
+ * the program, the folding must happen after the whole program has been
+ * analysed; an overload inserted later could change the value.
+ *
+ * Each evaluation may perform at most 'budget' operator calls. A
+ * subexpression that exceeds the budget, or that fails (for instance,
+ * because no overload matches), is left unchanged; it might not even be
+ * evaluated when the program runs.
+ *
+ * The body of the entry point is not evaluated as a whole, since that
+ * would run the program ahead of time; only its operands are folded.
+ * The same holds for the nullary operators it calls directly, and for
+ * the components of its pairs.
+ */
+#ifndef CONSTANT_FOLDING_H
+#define CONSTANT_FOLDING_H
+
+#include <cstddef>
+#include "operator.h"
+
+/* Folds the bodies of every operator reachable from the entry point. */
+void foldConstants( const NullaryOperator & entry, std::size_t budget );
+
+#endif // CONSTANT_FOLDING_H
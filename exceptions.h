@@ -36,4 +36,20 @@ struct semantic_error : public std::runtime_error {
         runtime_error( what )
     {}
 };
+
+/* Thrown by an evaluation that exceeded its step budget. */
+struct budget_exceeded : public std::runtime_error {
+    budget_exceeded() :
+        runtime_error( "Step budget exceeded" )
+    {}
+};
+
+/* Thrown by a parallel task whose result is no longer needed
+ * (see task_scheduler.h). It is not a semantic_error, so that
+ * no overload catches it. */
+struct task_cancelled : public std::runtime_error {
+    task_cancelled() :
+        runtime_error( "Task cancelled" )
+    {}
+};
 #endif // EXCEPTIONS_H
@@ -0,0 +1,631 @@
+/* image.cpp
+ * Implementation of image.h
+ */
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_map>
+#include "exceptions.h"
+#include "image.h"
+#include "symbol_table.h"
+
+namespace {
+
+/* The last byte is the version of the layout below. */
+const char magic[8] = { 'I', 'N', 'E', 'I', 'M', 'G', 0, 1 };
+
+const std::uint32_t none = -1;
+
+struct StringRef {
+    std::uint32_t offset, size; // In the table of characters.
+};
+
+struct Section {
+    std::uint64_t offset; // From the start of the image, in bytes.
+    std::uint64_t count;  // Of records.
+};
+
+struct Header {
+    char magic[8];
+    std::uint64_t hash;     // Of the sources.
+    std::uint64_t checksum; // Of everything after the header.
+    std::uint32_t entry;    // Index of the entry point in 'operators'.
+    std::uint32_t unused;
+    Section sources;    // StringRef
+    Section operators;  // OperatorRecord
+    Section overloads;  // OverloadRecord
+    Section parameters; // ParameterRecord
+    Section bodies;     // BodyRecord
+    Section characters; // char
+};
+
+/* The format tells the table of the operator and, with the
+ * priority, the priorities of its operands. */
+struct OperatorRecord {
+    StringRef name;
+    char format[4];
+    std::uint32_t priority;
+    std::uint32_t first_overload; // Index in 'overloads'.
+    std::uint32_t overload_count;
+};
+
+/* The body of a native overload is 'none'; so are
+ * the parameters beyond the arity of the operator. */
+struct OverloadRecord {
+    std::uint32_t body;
+    std::uint32_t parameters[2];
+    std::uint32_t frame_size;
+};
+
+/* The children of a node (in either tree) are stored before it,
+ * so that the indices decrease from the root down; invalid
+ * images thus cannot make loadImage loop. */
+struct ParameterRecord {
+    std::uint32_t kind;  // OperatorParameter::Kind
+    std::uint32_t token; // Id of the token of the name.
+    StringRef name;
+    std::int64_t value;  // Slot, or the number of a NumericParameter.
+    std::uint32_t first, second;
+};
+
+struct BodyRecord {
+    std::uint32_t kind; // OperatorBody::Kind
+    std::uint32_t op;   // Index in 'operators', for tree nodes.
+    std::uint32_t first, second;
+    std::int64_t value; // Number of a NumericBody, or slot of a VariableBody.
+    StringRef name;     // Of a VariableBody.
+};
+
+static_assert( std::is_trivially_copyable<Header>::value &&
+        sizeof(Header) % 8 == 0 && sizeof(OperatorRecord) % 8 == 0 &&
+        sizeof(OverloadRecord) % 8 == 0 && sizeof(ParameterRecord) % 8 == 0 &&
+        sizeof(BodyRecord) % 8 == 0, "Records must keep the sections aligned" );
+
+unsigned arity( const char * format ) {
+    return format[0] == 'f' ? (format[1] ? 1 : 0) : (format[2] ? 2 : 1);
+}
+
+/* FNV-1a hash. */
+std::uint64_t hash( const char * data, std::size_t size,
+        std::uint64_t hash = 14695981039346656037u )
+{
+    for( std::size_t i = 0; i < size; ++i )
+        hash = (hash ^ (unsigned char) data[i]) * 1099511628211u;
+    return hash;
+}
+
+/* Hash of the names and contents of the files.
+ * Returns false if some file cannot be read. */
+bool hash_sources( const std::vector<std::string> & sources, std::uint64_t & result ) {
+    result = hash( nullptr, 0 );
+    for( const auto & source : sources ) {
+        std::ifstream in( source, std::ios::in | std::ios::binary );
+        if( !in )
+            return false;
+        std::string contents( std::istreambuf_iterator<char>(in), {} );
+        /* The terminators keep the boundaries between the strings. */
+        result = hash( source.c_str(), source.size() + 1, result );
+        result = hash( contents.c_str(), contents.size() + 1, result );
+    }
+    return true;
+}
+
+struct Writer {
+    std::vector<StringRef> sources;
+    std::vector<OperatorRecord> operators;
+    std::vector<OverloadRecord> overloads;
+    std::vector<ParameterRecord> parameters;
+    std::vector<BodyRecord> bodies;
+    std::string characters;
+
+    std::unordered_map<Name, StringRef> strings;
+    std::unordered_map<const Symbol *, unsigned> ids;
+    std::vector<std::pair<const Symbol *, unsigned>> pending; // Operators and arities.
+
+    StringRef string( Name name ) {
+        auto pair = strings.emplace( name, StringRef{} );
+        if( pair.second ) {
+            pair.first->second = StringRef{ std::uint32_t(characters.size()),
+                std::uint32_t(name.str().size()) };
+            characters += name.str();
+        }
+        return pair.first->second;
+    }
+
+    /* Returns the index of the operator, registering it if needed. */
+    unsigned id( const Symbol * op, unsigned arity ) {
+        auto pair = ids.emplace( op, operators.size() );
+        if( !pair.second )
+            return pair.first->second;
+
+        OperatorRecord record{ string(op->name), {}, 0, 0, 0 };
+        std::string format;
+        if( arity == 0 ) {
+            format = "f";
+            record.priority = static_cast<const NullaryOperator *>( op )->priority;
+        }
+        else if( arity == 1 ) {
+            auto unary = static_cast<const UnaryOperator *>( op );
+            bool fx = unary->operand_priority != unary->priority;
+            if( SymbolTable::retrievePrefixOperator( op->name ) == unary )
+                format = fx ? "fx" : "fy";
+            else
+                format = fx ? "xf" : "yf";
+            record.priority = unary->priority;
+        }
+        else {
+            auto binary = static_cast<const BinaryOperator *>( op );
+            if( binary->left_priority == binary->priority )
+                format = "yfx";
+            else if( binary->right_priority == binary->priority )
+                format = "xfy";
+            else
+                format = "xfx";
+            record.priority = binary->priority;
+        }
+        format.copy( record.format, sizeof(record.format) - 1 );
+        operators.push_back( record );
+        pending.emplace_back( op, arity );
+        return pair.first->second;
+    }
+
+    unsigned parameter( const OperatorParameter & parameter ) {
+        ParameterRecord record{ std::uint32_t(parameter.kind), 0, {}, 0, none, none };
+        switch( parameter.kind ) {
+            case OperatorParameter::named: {
+                auto & named = static_cast<const NamedParameter &>( parameter );
+                record.token = named.name.id;
+                record.name = string( named.name.lexeme );
+                record.value = named.slot;
+                break;
+            }
+            case OperatorParameter::restricted: {
+                auto & restricted = static_cast<const RestrictedParameter &>( parameter );
+                record.token = restricted.name.id;
+                record.name = string( restricted.name.lexeme );
+                record.value = restricted.slot;
+                break;
+            }
+            case OperatorParameter::numeric: {
+                auto & numeric = static_cast<const NumericParameter &>( parameter );
+                record.token = numeric.name.id;
+                record.name = string( numeric.name.lexeme );
+                record.value = numeric.value;
+                break;
+            }
+            case OperatorParameter::pair: {
+                auto & pair = static_cast<const PairParameter &>( parameter );
+                record.first = this->parameter( *pair.first );
+                record.second = this->parameter( *pair.second );
+                break;
+            }
+        }
+        parameters.push_back( record );
+        return parameters.size() - 1;
+    }
+
+    unsigned body( const OperatorBody & body ) {
+        BodyRecord record{ std::uint32_t(body.kind), none, none, none, 0, {} };
+        switch( body.kind ) {
+            case OperatorBody::pair: {
+                auto & pair = static_cast<const PairBody &>( body );
+                record.first = this->body( *pair.first );
+                record.second = this->body( *pair.second );
+                break;
+            }
+            case OperatorBody::variable: {
+                auto & variable = static_cast<const VariableBody &>( body );
+                record.name = string( variable.name );
+                record.value = variable.slot;
+                break;
+            }
+            case OperatorBody::numeric:
+                record.value = static_cast<const NumericBody &>( body ).value;
+                break;
+            case OperatorBody::nullary:
+                record.op = id( static_cast<const NullaryTreeBody &>( body ).op, 0 );
+                break;
+            case OperatorBody::unary: {
+                auto & tree = static_cast<const UnaryTreeBody &>( body );
+                record.op = id( tree.op, 1 );
+                record.first = this->body( *tree.variable );
+                break;
+            }
+            case OperatorBody::binary: {
+                auto & tree = static_cast<const BinaryTreeBody &>( body );
+                record.op = id( tree.op, 2 );
+                record.first = this->body( *tree.left );
+                record.second = this->body( *tree.right );
+                break;
+            }
+            default:
+                /* Images are written right after the analysis,
+                 * before constant folding. */
+                throw std::logic_error( "Unexpected body in image" );
+        }
+        bodies.push_back( record );
+        return bodies.size() - 1;
+    }
+
+    template< typename Operator >
+    void write_overloads( unsigned index, const Operator & op ) {
+        operators[index].first_overload = overloads.size();
+        operators[index].overload_count = op.overloads.size();
+        for( const auto & overload : op.overloads )
+            overloads.push_back( record(*overload) );
+    }
+
+    OverloadRecord record( const NullaryOverload & overload ) {
+        return OverloadRecord{ body_of(overload), {none, none}, overload.frame_size };
+    }
+    OverloadRecord record( const UnaryOverload & overload ) {
+        return OverloadRecord{ body_of(overload),
+            {parameter(*overload.variable), none}, overload.frame_size };
+    }
+    OverloadRecord record( const BinaryOverload & overload ) {
+        return OverloadRecord{ body_of(overload),
+            {parameter(*overload.left), parameter(*overload.right)}, overload.frame_size };
+    }
+    unsigned body_of( const OperatorOverload & overload ) {
+        if( overload.body->kind == OperatorBody::native )
+            return none;
+        return body( *overload.body );
+    }
+
+    void write_pending() {
+        while( !pending.empty() ) {
+            auto pair = pending.back();
+            pending.pop_back();
+            unsigned index = ids[pair.first];
+            switch( pair.second ) {
+                case 0: write_overloads( index, *static_cast<const NullaryOperator *>( pair.first ) ); break;
+                case 1: write_overloads( index, *static_cast<const UnaryOperator *>( pair.first ) ); break;
+                case 2: write_overloads( index, *static_cast<const BinaryOperator *>( pair.first ) ); break;
+            }
+        }
+    }
+};
+
+/* Appends the records to the file, keeping the alignment. */
+template< typename Record >
+Section append( std::string & file, const std::vector<Record> & records ) {
+    file.resize( (file.size() + 7) & ~std::size_t(7) );
+    Section section{ file.size(), records.size() };
+    file.append( reinterpret_cast<const char *>( records.data() ), records.size() * sizeof(Record) );
+    return section;
+}
+
+/* Read-only mapping of a whole file; data() is null if the file
+ * cannot be mapped. */
+class Mapping {
+    void * address = MAP_FAILED;
+    std::size_t length = 0;
+
+public:
+    explicit Mapping( const char * filename ) {
+        int fd = open( filename, O_RDONLY );
+        if( fd < 0 )
+            return;
+        struct stat status;
+        if( fstat( fd, &status ) == 0 && status.st_size > 0 ) {
+            length = status.st_size;
+            address = mmap( nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+        }
+        close( fd );
+    }
+    ~Mapping() {
+        if( address != MAP_FAILED )
+            munmap( address, length );
+    }
+    Mapping( const Mapping& ) = delete;
+    Mapping& operator=( const Mapping& ) = delete;
+
+    const char * data() const {
+        return address == MAP_FAILED ? nullptr : static_cast<const char *>( address );
+    }
+    std::size_t size() const { return length; }
+};
+
+/* Validates the image, and then inserts its operators.
+ * The records are read in place, from the mapping. */
+class Reader {
+    const char * image;
+    std::size_t size;
+    const Header * header;
+
+    const StringRef * sources = nullptr;
+    const OperatorRecord * operators = nullptr;
+    const OverloadRecord * overloads = nullptr;
+    const ParameterRecord * parameters = nullptr;
+    const BodyRecord * bodies = nullptr;
+    const char * characters = nullptr;
+
+    std::vector<const Symbol *> symbols; // Indexed as 'operators'.
+
+    template< typename Record >
+    bool section( const Section & s, const Record *& records ) {
+        if( s.offset % alignof(Record) != 0 || s.offset > size ||
+                s.count > (size - s.offset) / sizeof(Record) )
+            return false;
+        records = reinterpret_cast<const Record *>( image + s.offset );
+        return true;
+    }
+
+    bool valid( StringRef ref ) const {
+        return ref.offset <= header->characters.count &&
+            ref.size <= header->characters.count - ref.offset;
+    }
+    std::string string( StringRef ref ) const {
+        return std::string( characters + ref.offset, ref.size );
+    }
+
+    /* Returns the operator already in the SymbolTable, if any. */
+    const Symbol * existing( const OperatorRecord & record ) const {
+        Name name = string( record.name );
+        switch( arity(record.format) ) {
+            case 0: return SymbolTable::retrieveNullaryOperator( name );
+            case 1: return record.format[0] == 'f' ?
+                        SymbolTable::retrievePrefixOperator( name ) :
+                        SymbolTable::retrievePostfixOperator( name );
+            default: return SymbolTable::retrieveBinaryOperator( name );
+        }
+    }
+
+    /* 'frame_size' is the one of the overload that contains the node. */
+    bool valid_parameter( std::uint32_t index, std::uint32_t limit, std::uint32_t frame_size ) const {
+        if( index >= limit )
+            return false;
+        const ParameterRecord & p = parameters[index];
+        switch( p.kind ) {
+            case OperatorParameter::named:
+            case OperatorParameter::restricted:
+                return valid( p.name ) && p.value >= 0 && p.value < frame_size;
+            case OperatorParameter::numeric:
+                return valid( p.name );
+            case OperatorParameter::pair:
+                return valid_parameter( p.first, index, frame_size ) &&
+                    valid_parameter( p.second, index, frame_size );
+            default:
+                return false;
+        }
+    }
+
+    bool valid_body( std::uint32_t index, std::uint32_t limit, std::uint32_t frame_size ) const {
+        if( index >= limit )
+            return false;
+        const BodyRecord & b = bodies[index];
+        auto calls = [&]( unsigned operator_arity ) {
+            return b.op < header->operators.count &&
+                arity( operators[b.op].format ) == operator_arity;
+        };
+        switch( b.kind ) {
+            case OperatorBody::pair:
+                return valid_body( b.first, index, frame_size ) &&
+                    valid_body( b.second, index, frame_size );
+            case OperatorBody::variable:
+                return valid( b.name ) && b.value >= 0 && b.value < frame_size;
+            case OperatorBody::numeric:
+                return true;
+            case OperatorBody::nullary:
+                return calls( 0 );
+            case OperatorBody::unary:
+                return calls( 1 ) && valid_body( b.first, index, frame_size );
+            case OperatorBody::binary:
+                return calls( 2 ) && valid_body( b.first, index, frame_size ) &&
+                    valid_body( b.second, index, frame_size );
+            default:
+                return false;
+        }
+    }
+
+    bool valid_operator( const OperatorRecord & op ) const {
+        static const char * formats[] = { "f", "fx", "fy", "xf", "yf", "xfx", "xfy", "yfx" };
+        bool known = false;
+        for( const char * format : formats )
+            known = known || std::strncmp( op.format, format, sizeof(op.format) ) == 0;
+        if( !known || !valid( op.name ) || op.first_overload > header->overloads.count ||
+                op.overload_count > header->overloads.count - op.first_overload )
+            return false;
+
+        /* Only the operators inserted at startup may have native
+         * overloads, and these must be the ones already inserted. */
+        const Symbol * symbol = existing( op );
+        unsigned natives = 0;
+        while( natives < op.overload_count &&
+                overloads[op.first_overload + natives].body == none )
+            ++natives;
+        if( symbol && natives != inserted_overloads( symbol, arity(op.format) ) )
+            return false;
+        if( !symbol && arity(op.format) == 0 && SymbolTable::existsCategory( string(op.name) ) )
+            return false;
+
+        for( unsigned i = natives; i < op.overload_count; ++i ) {
+            const OverloadRecord & overload = overloads[op.first_overload + i];
+            /* Each slot is the one of some variable of the signature. */
+            if( overload.frame_size > header->parameters.count )
+                return false;
+            if( !valid_body( overload.body, header->bodies.count, overload.frame_size ) )
+                return false;
+            for( unsigned j = 0; j < arity(op.format); ++j )
+                if( !valid_parameter( overload.parameters[j], header->parameters.count,
+                            overload.frame_size ) )
+                    return false;
+        }
+        return true;
+    }
+
+    static unsigned inserted_overloads( const Symbol * symbol, unsigned arity ) {
+        switch( arity ) {
+            case 0: return static_cast<const NullaryOperator *>( symbol )->overloads.size();
+            case 1: return static_cast<const UnaryOperator *>( symbol )->overloads.size();
+            default: return static_cast<const BinaryOperator *>( symbol )->overloads.size();
+        }
+    }
+
+    std::unique_ptr<OperatorParameter> parameter( std::uint32_t index ) const {
+        const ParameterRecord & p = parameters[index];
+        Token token{ p.token, string(p.name), 0, 0 };
+        switch( p.kind ) {
+            case OperatorParameter::named:
+                return std::make_unique<NamedParameter>( token, unsigned(p.value) );
+            case OperatorParameter::restricted:
+                return std::make_unique<RestrictedParameter>( token, unsigned(p.value) );
+            case OperatorParameter::numeric:
+                return std::make_unique<NumericParameter>( token, unsigned(p.value) );
+            default:
+                return std::make_unique<PairParameter>( parameter(p.first), parameter(p.second) );
+        }
+    }
+
+    std::unique_ptr<OperatorBody> body( std::uint32_t index ) const {
+        const BodyRecord & b = bodies[index];
+        switch( b.kind ) {
+            case OperatorBody::pair:
+                return std::make_unique<PairBody>( body(b.first), body(b.second) );
+            case OperatorBody::variable:
+                return std::make_unique<VariableBody>( Name(string(b.name)), unsigned(b.value) );
+            case OperatorBody::numeric:
+                return std::make_unique<NumericBody>( (long long) b.value );
+            case OperatorBody::nullary:
+                return std::make_unique<NullaryTreeBody>(
+                        static_cast<const NullaryOperator *>( symbols[b.op] ) );
+            case OperatorBody::unary:
+                return std::make_unique<UnaryTreeBody>(
+                        static_cast<const UnaryOperator *>( symbols[b.op] ), body(b.first) );
+            default:
+                return std::make_unique<BinaryTreeBody>(
+                        static_cast<const BinaryOperator *>( symbols[b.op] ),
+                        body(b.first), body(b.second) );
+        }
+    }
+
+    std::unique_ptr<OperatorOverload> overload( const OperatorRecord & op,
+            const OverloadRecord & record ) const
+    {
+        Name name = string( op.name );
+        std::unique_ptr<OperatorOverload> overload;
+        switch( arity(op.format) ) {
+            case 0:
+                overload = std::make_unique<NullaryOverload>( name, body(record.body) );
+                break;
+            case 1:
+                overload = std::make_unique<UnaryOverload>( name, body(record.body),
+                        parameter(record.parameters[0]) );
+                break;
+            default:
+                overload = std::make_unique<BinaryOverload>( name, body(record.body),
+                        parameter(record.parameters[0]), parameter(record.parameters[1]) );
+                break;
+        }
+        overload->frame_size = record.frame_size;
+        return overload;
+    }
+
+    void insert_overloads( const OperatorRecord & op ) const {
+        for( unsigned i = 0; i < op.overload_count; ++i ) {
+            const OverloadRecord & record = overloads[op.first_overload + i];
+            if( record.body != none )
+                SymbolTable::insertOverload( string(op.name), op.format, op.priority,
+                        overload( op, record ) );
+        }
+    }
+
+public:
+    Reader( const char * image, std::size_t size ) :
+        image( image ),
+        size( size ),
+        header( reinterpret_cast<const Header *>( image ) )
+    {}
+
+    bool valid( const char * program ) {
+        if( size < sizeof(Header) || std::memcmp( header->magic, magic, sizeof(magic) ) != 0 ||
+                hash( image + sizeof(Header), size - sizeof(Header) ) != header->checksum )
+            return false;
+        if( !section( header->sources, sources ) || !section( header->operators, operators ) ||
+                !section( header->overloads, overloads ) || !section( header->parameters, parameters ) ||
+                !section( header->bodies, bodies ) || !section( header->characters, characters ) )
+            return false;
+
+        // Stale images.
+        std::vector<std::string> files;
+        for( std::uint64_t i = 0; i < header->sources.count; ++i ) {
+            if( !valid( sources[i] ) )
+                return false;
+            files.push_back( string(sources[i]) );
+        }
+        std::uint64_t sources_hash;
+        if( files.empty() || files[0] != program || !hash_sources( files, sources_hash ) ||
+                sources_hash != header->hash )
+            return false;
+
+        if( header->entry >= header->operators.count ||
+                arity( operators[header->entry].format ) != 0 )
+            return false;
+        for( std::uint64_t i = 0; i < header->operators.count; ++i )
+            if( !valid_operator( operators[i] ) )
+                return false;
+        return true;
+    }
+
+    /* Assumes valid(). */
+    void load() {
+        for( std::uint64_t i = 0; i < header->operators.count; ++i ) {
+            const OperatorRecord & op = operators[i];
+            SymbolTable::declareOperator( string(op.name), op.format, op.priority, 0 );
+            symbols.push_back( existing(op) );
+        }
+        /* The entry point must be the last nullary operator inserted. */
+        for( std::uint64_t i = 0; i < header->operators.count; ++i )
+            if( i != header->entry )
+                insert_overloads( operators[i] );
+        insert_overloads( operators[header->entry] );
+    }
+};
+
+} // anonymous namespace
+
+void writeImage( const char * filename, const NullaryOperator & entry,
+        const std::vector<std::string> & sources )
+{
+    Writer writer;
+    Header header{};
+    std::memcpy( header.magic, magic, sizeof(magic) );
+    if( !hash_sources( sources, header.hash ) )
+        throw file_error( "Error reading the sources of the image" );
+    for( const auto & source : sources )
+        writer.sources.push_back( writer.string( source ) );
+    header.entry = writer.id( &entry, 0 );
+    writer.write_pending();
+
+    std::string file( sizeof(Header), '\0' );
+    header.sources = append( file, writer.sources );
+    header.operators = append( file, writer.operators );
+    header.overloads = append( file, writer.overloads );
+    header.parameters = append( file, writer.parameters );
+    header.bodies = append( file, writer.bodies );
+    header.characters = append( file, std::vector<char>( writer.characters.begin(), writer.characters.end() ) );
+    header.checksum = hash( file.data() + sizeof(Header), file.size() - sizeof(Header) );
+    std::memcpy( &file[0], &header, sizeof(Header) );
+
+    std::ofstream out( filename, std::ios::out | std::ios::binary | std::ios::trunc );
+    out.write( file.data(), file.size() );
+    if( !out )
+        throw file_error( "Error writing the image" );
+}
+
+bool loadImage( const char * filename, const char * program ) {
+    Mapping mapping( filename );
+    if( !mapping.data() )
+        return false;
+    Reader reader( mapping.data(), mapping.size() );
+    if( !reader.valid( program ) )
+        return false;
+    reader.load();
+    return true;
+}
@@ -0,0 +1,52 @@
+/* image.h
+ * Images of analysed programs.
+ *
+ * Before running anything, the interpreter lexes and parses every file
+ * of the program and builds the tree of every body; for short runs, this
+ * may take longer than the evaluation itself. writeImage saves the result
+ * of the analysis to a file, from which loadImage restores it later:
+ *
+ *  ./a.out --compile-to peano.img examples/peano
+ *  ./a.out --load peano.img examples/peano
+ *
+ * The image holds the entry point and every operator reachable from it:
+ * their signatures, the patterns of their overloads and the trees of the
+ * bodies. The categories are not needed, since the trees hold their values.
+ * Everything is stored as arrays of fixed-size records, that refer to
+ * each other by index; strings are positions in a table of characters.
+ * The image holds no pointers, so it is read in place, through mmap.
+ * Loading creates the operators in the SymbolTable straight from the
+ * records, in a single pass, without lexing, parsing or analysing
+ * anything. The native operations are not stored: the overloads inserted
+ * by the interpreter at startup are used instead.
+ *
+ * The image also stores the names of the files read to analyse the
+ * program (the program itself and the included files), and a hash of
+ * their names and contents. If the image was compiled from another
+ * program, or if some of these files changed, the image is stale.
+ * A checksum of the records, and bounds checks on every index, reject
+ * damaged images before anything is inserted.
+ *
+ * The layout of the records is the one of the machine that wrote the
+ * image; the images are not meant to be moved between machines.
+ */
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <string>
+#include <vector>
+#include "operator.h"
+
+/* Writes the entry point, and every operator reachable from it, to the file.
+ * 'sources' are the files read to analyse the program, the program first.
+ * Throws file_error if the file cannot be written. */
+void writeImage( const char * filename, const NullaryOperator & entry,
+        const std::vector<std::string> & sources );
+
+/* Inserts the operators of the image in the SymbolTable; the entry point
+ * becomes the last nullary operator inserted.
+ * Returns false, and inserts nothing, if the image cannot be read,
+ * is not valid, or is stale for the given program. */
+bool loadImage( const char * filename, const char * program );
+
+#endif // IMAGE_H
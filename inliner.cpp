@@ -0,0 +1,244 @@
+/* inliner.cpp
+ * Implementation of inliner.h
+ */
+#include <algorithm>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "inliner.h"
+
+namespace {
+
+/* Returns the number of nodes of the body, or 0 if the body has
+ * nodes that cannot be inlined, like native operations. */
+unsigned size( const OperatorBody & body ) {
+    switch( body.kind ) {
+        case OperatorBody::pair: {
+            auto & pair = static_cast<const PairBody &>( body );
+            unsigned first = size( *pair.first );
+            unsigned second = size( *pair.second );
+            return first && second ? 1 + first + second : 0;
+        }
+        case OperatorBody::unary: {
+            unsigned variable = size( *static_cast<const UnaryTreeBody &>( body ).variable );
+            return variable ? 1 + variable : 0;
+        }
+        case OperatorBody::binary: {
+            auto & tree = static_cast<const BinaryTreeBody &>( body );
+            unsigned left = size( *tree.left );
+            unsigned right = size( *tree.right );
+            return left && right ? 1 + left + right : 0;
+        }
+        case OperatorBody::nullary:
+        case OperatorBody::variable:
+        case OperatorBody::numeric:
+        case OperatorBody::constant:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* Walks the body in evaluation order, the operands of a node before
+ * the node, and checks that the variables in 'slots' are read one after
+ * the other, once each, before any operator is called. 'next' is the
+ * index in 'slots' of the next variable expected. */
+bool reads_first( const OperatorBody & body, const std::vector<int> & slots, unsigned & next ) {
+    switch( body.kind ) {
+        case OperatorBody::pair: {
+            auto & pair = static_cast<const PairBody &>( body );
+            return reads_first( *pair.first, slots, next )
+                && reads_first( *pair.second, slots, next );
+        }
+        case OperatorBody::unary:
+            return reads_first( *static_cast<const UnaryTreeBody &>( body ).variable, slots, next )
+                && next == slots.size();
+        case OperatorBody::binary: {
+            auto & tree = static_cast<const BinaryTreeBody &>( body );
+            return reads_first( *tree.left, slots, next )
+                && reads_first( *tree.right, slots, next )
+                && next == slots.size();
+        }
+        case OperatorBody::nullary:
+            return next == slots.size();
+        case OperatorBody::variable: {
+            int slot = static_cast<const VariableBody &>( body ).slot;
+            if( std::find( slots.begin(), slots.end(), slot ) == slots.end() )
+                return true;
+            return next < slots.size() && slots[next++] == slot;
+        }
+        default:
+            return true;
+    }
+}
+
+/* Bodies that cannot fail, and cost nothing to evaluate twice. */
+bool is_leaf( const OperatorBody & body ) {
+    return body.kind == OperatorBody::variable ||
+           body.kind == OperatorBody::numeric ||
+           body.kind == OperatorBody::constant;
+}
+
+/* Returns the slot of the parameter, or -1 if it restricts its argument. */
+int slot( const OperatorParameter & parameter ) {
+    if( parameter.kind == OperatorParameter::named )
+        return static_cast<const NamedParameter &>( parameter ).slot;
+    return -1;
+}
+
+/* Replaces each variable of the body by a copy of the argument in its slot. */
+void substitute( std::unique_ptr<OperatorBody> & body,
+        const std::vector<const OperatorBody *> & arguments )
+{
+    switch( body->kind ) {
+        case OperatorBody::pair: {
+            auto & pair = static_cast<PairBody &>( *body );
+            substitute( pair.first, arguments );
+            substitute( pair.second, arguments );
+            break;
+        }
+        case OperatorBody::unary:
+            substitute( static_cast<UnaryTreeBody &>( *body ).variable, arguments );
+            break;
+        case OperatorBody::binary: {
+            auto & tree = static_cast<BinaryTreeBody &>( *body );
+            substitute( tree.left, arguments );
+            substitute( tree.right, arguments );
+            break;
+        }
+        case OperatorBody::variable:
+            body.reset( arguments[static_cast<VariableBody &>( *body ).slot]->clone() );
+            break;
+        default:
+            break;
+    }
+}
+
+struct Inliner {
+    unsigned threshold;
+    std::unordered_set<const Symbol *> visited;
+    std::vector<std::pair<const Symbol *, unsigned>> pending; // Operators and arities.
+    std::vector<const Symbol *> expanding; // Recursion guard.
+
+    void visit( const Symbol * op, unsigned arity ) {
+        if( visited.insert( op ).second )
+            pending.emplace_back( op, arity );
+    }
+
+    /* Returns the slots of the parameters of the only overload of the
+     * operator, or false if the operator cannot be inlined. */
+    bool parameters( const NullaryOperator &, std::vector<int> & ) {
+        return true;
+    }
+    bool parameters( const UnaryOperator & op, std::vector<int> & slots ) {
+        slots = { slot( *op.overloads[0]->variable ) };
+        return slots[0] >= 0;
+    }
+    bool parameters( const BinaryOperator & op, std::vector<int> & slots ) {
+        slots = { slot( *op.overloads[0]->left ), slot( *op.overloads[0]->right ) };
+        return slots[0] >= 0 && slots[1] >= 0 && slots[0] != slots[1];
+    }
+
+    /* Replaces the call by the body of the operator, if possible.
+     * 'arguments' are the arguments of the call, already expanded;
+     * the body is expanded before they are substituted into it, so
+     * that they are not walked again. */
+    template< typename Operator >
+    void expand_call( std::unique_ptr<OperatorBody> & call, const Operator & op,
+            const std::vector<const OperatorBody *> & arguments )
+    {
+        std::vector<int> slots;
+        if( op.overloads.size() != 1 || !parameters( op, slots ) )
+            return;
+        if( std::find( expanding.begin(), expanding.end(), &op ) != expanding.end() )
+            return;
+        const OperatorOverload & overload = *op.overloads[0];
+        unsigned body_size = size( *overload.body );
+        if( body_size == 0 || body_size > threshold )
+            return;
+
+        std::unique_ptr<OperatorBody> body( overload.body->clone() );
+        expanding.push_back( &op );
+        expand( body );
+        expanding.pop_back();
+
+        /* The reads are checked after the expansion,
+         * which may have duplicated or moved the variables. */
+        std::vector<const OperatorBody *> by_slot( overload.frame_size );
+        std::vector<int> computed; // Slots of the arguments that are not leaves.
+        for( unsigned i = 0; i < arguments.size(); ++i ) {
+            if( !is_leaf( *arguments[i] ) )
+                computed.push_back( slots[i] );
+            by_slot[slots[i]] = arguments[i];
+        }
+        unsigned next = 0;
+        if( !reads_first( *body, computed, next ) || next != computed.size() )
+            return;
+
+        substitute( body, by_slot );
+        call = std::move( body );
+    }
+
+    /* Expands the calls in the body, from the leaves up. */
+    void expand( std::unique_ptr<OperatorBody> & body ) {
+        switch( body->kind ) {
+            case OperatorBody::pair: {
+                auto & pair = static_cast<PairBody &>( *body );
+                expand( pair.first );
+                expand( pair.second );
+                break;
+            }
+            case OperatorBody::nullary: {
+                auto & tree = static_cast<NullaryTreeBody &>( *body );
+                visit( tree.op, 0 );
+                expand_call( body, *tree.op, {} );
+                break;
+            }
+            case OperatorBody::unary: {
+                auto & tree = static_cast<UnaryTreeBody &>( *body );
+                visit( tree.op, 1 );
+                expand( tree.variable );
+                expand_call( body, *tree.op, { tree.variable.get() } );
+                break;
+            }
+            case OperatorBody::binary: {
+                auto & tree = static_cast<BinaryTreeBody &>( *body );
+                visit( tree.op, 2 );
+                expand( tree.left );
+                expand( tree.right );
+                expand_call( body, *tree.op, { tree.left.get(), tree.right.get() } );
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    template< typename Operator >
+    void expand_overloads( const Symbol * symbol ) {
+        expanding.push_back( symbol );
+        for( const auto & overload : static_cast<const Operator *>( symbol )->overloads )
+            expand( overload->body );
+        expanding.pop_back();
+    }
+
+    void expand_pending() {
+        while( !pending.empty() ) {
+            auto pair = pending.back();
+            pending.pop_back();
+            switch( pair.second ) {
+                case 0: expand_overloads<NullaryOperator>( pair.first ); break;
+                case 1: expand_overloads<UnaryOperator>( pair.first ); break;
+                case 2: expand_overloads<BinaryOperator>( pair.first ); break;
+            }
+        }
+    }
+};
+
+} // anonymous namespace
+
+void inlineOperators( const NullaryOperator & entry, unsigned threshold ) {
+    Inliner inliner{ threshold, {}, {}, {} };
+    inliner.visit( &entry, 0 );
+    inliner.expand_pending();
+}
@@ -0,0 +1,44 @@
+/* inliner.h
+ * Substitution of calls to small operators by their bodies.
+ *
+ * Many operators merely forward to others, like
+ *
+ *  xfx 1000 X >= Y
+ *      Y <= X
+ *
+ * A call to such an operator costs a dispatch, a frame and the
+ * evaluation of a body. After semantic analysis, inlineOperators
+ * replaces the call 'A >= B' by the body 'B <= A', with the parameters
+ * replaced by the arguments of the call.
+ *
+ * A call is replaced only if it always selects the same overload: the
+ * operator must have a single overload, whose parameters are plain
+ * variables with distinct names (a pattern like 'X == X' restricts its
+ * arguments). Since the overloads are selected among every overload of
+ * the program, this must be done after the whole program has been
+ * analysed; an overload inserted later would make the call conditional.
+ *
+ * Arguments are evaluated before the body, in order, even if the body
+ * does not use them; a call fails, or never ends, if one of its arguments
+ * does. Thus, the arguments that are not variables or constants must be
+ * used exactly once in the body, in the order of the arguments, and
+ * before the body calls any operator. The body is evaluated operands
+ * first, from left to right; thus, 'A >= B' is inlined as 'B <= A' only
+ * if A or B is a variable or a constant.
+ * Bodies with native operations, which read the frame of the call, are
+ * never inlined.
+ *
+ * Only bodies with at most 'threshold' nodes are inlined. The bodies
+ * inlined are themselves expanded, except for calls to the operators
+ * being expanded, so that recursive operators are never unrolled.
+ */
+#ifndef INLINER_H
+#define INLINER_H
+
+#include "operator.h"
+
+/* Expands the calls in the bodies of every operator
+ * reachable from the entry point. */
+void inlineOperators( const NullaryOperator & entry, unsigned threshold );
+
+#endif // INLINER_H
@@ -0,0 +1,218 @@
+/* lazy_evaluator.cpp
+ * Implementation of lazy_evaluator.h
+ */
+#include <exception>
+#include <memory>
+#include "exceptions.h"
+#include "lazy_evaluator.h"
+
+namespace {
+
+class LazyFrame;
+
+/* An operand of a call, with the frame of the body that contains it. */
+struct Thunk {
+    const OperatorBody * body = nullptr;
+    const LazyFrame * frame = nullptr;
+    bool forced = false;
+    Variable value; // Valid if forced.
+    std::exception_ptr error; // The semantic_error raised when forced, if any.
+
+    const Variable & force();
+};
+
+/* Raised by a thunk that failed. It unwinds up to the call that created
+ * the thunk, where the semantic_error is raised again; being no
+ * semantic_error, no overload in between catches it. */
+struct operand_failed {
+    const Thunk * thunk;
+};
+
+/* The value bound to a pattern variable: either an operand, maybe not
+ * yet forced, or a part of some value already forced. */
+struct Slot {
+    Thunk * thunk = nullptr;
+    const Variable * value = nullptr;
+
+    explicit operator bool() const { return thunk || value; }
+    const Variable & force() const {
+        return value ? *value : thunk->force();
+    }
+};
+
+/* Counterpart of Frame (see variable.h) whose slots hold Slot objects. */
+class LazyFrame {
+    static const unsigned inline_slots = 8;
+    Slot inline_storage[inline_slots];
+    std::unique_ptr<Slot[]> heap_storage;
+    Slot * slots;
+    unsigned count;
+
+public:
+    explicit LazyFrame( unsigned size ) :
+        heap_storage( size > inline_slots ? new Slot[size] : nullptr ),
+        slots( size > inline_slots ? heap_storage.get() : inline_storage ),
+        count( size )
+    {}
+
+    LazyFrame( const LazyFrame& ) = delete;
+    LazyFrame & operator=( const LazyFrame& ) = delete;
+
+    unsigned size() const { return count; }
+    Slot & operator[]( unsigned slot ) { return slots[slot]; }
+    const Slot & operator[]( unsigned slot ) const { return slots[slot]; }
+
+    /* Binds the slot, forcing both values if the slot is already bound. */
+    bool bind( unsigned slot, Slot value ) {
+        if( !slots[slot] ) {
+            slots[slot] = value;
+            return true;
+        }
+        return slots[slot].force() == value.force();
+    }
+};
+
+Variable evaluate( const OperatorBody &, const LazyFrame & );
+
+const Variable & Thunk::force() {
+    if( error )
+        throw operand_failed{ this };
+    if( !forced ) {
+        try {
+            value = evaluate( *body, *frame );
+        } catch( semantic_error & ) {
+            error = std::current_exception();
+            throw operand_failed{ this };
+        }
+        forced = true;
+    }
+    return value;
+}
+
+/* Matches the argument against the pattern; only plain
+ * variables leave the argument unforced. */
+bool match( const OperatorParameter & parameter, Slot argument, LazyFrame & frame ) {
+    if( parameter.kind == OperatorParameter::named )
+        return frame.bind( static_cast<const NamedParameter &>( parameter ).slot, argument );
+    const Variable & value = argument.force();
+    switch( parameter.kind ) {
+        case OperatorParameter::restricted:
+            return !value.is_pair() && frame.bind(
+                    static_cast<const RestrictedParameter &>( parameter ).slot,
+                    Slot{ nullptr, &value } );
+        case OperatorParameter::numeric:
+            return !value.is_pair() &&
+                value.value() == static_cast<const NumericParameter &>( parameter ).value;
+        default: {
+            auto & pair = static_cast<const PairParameter &>( parameter );
+            return value.is_pair() &&
+                match( *pair.first, Slot{ nullptr, &value.first() }, frame ) &&
+                match( *pair.second, Slot{ nullptr, &value.second() }, frame );
+        }
+    }
+}
+
+bool match( const NullaryOverload &, LazyFrame & ) {
+    return true;
+}
+bool match( const UnaryOverload & overload, LazyFrame & frame, Slot argument ) {
+    return match( *overload.variable, argument, frame );
+}
+bool match( const BinaryOverload & overload, LazyFrame & frame, Slot left, Slot right ) {
+    return match( *overload.left, left, frame ) && match( *overload.right, right, frame );
+}
+
+/* Tries each overload in insertion order, like OperatorBase::_compute. */
+template< typename Operator, typename ... Slots >
+Variable call( const Operator & op, Slots ... arguments ) {
+    for( const auto & overload : op.overloads ) {
+        LazyFrame frame( overload->frame_size );
+        if( !match( *overload, frame, arguments... ) )
+            continue;
+        try {
+            return evaluate( *overload->body, frame );
+        } catch( semantic_error & ) {
+            // Found invalid overload.
+        }
+    }
+    throw semantic_error( "No valid overload found" );
+}
+
+/* Returns the slot for the operand; 'thunk' is used
+ * unless the operand is a variable or a constant. */
+Slot operand( const OperatorBody & body, const LazyFrame & frame, Thunk & thunk ) {
+    switch( body.kind ) {
+        case OperatorBody::variable:
+            return frame[static_cast<const VariableBody &>( body ).slot];
+        case OperatorBody::numeric:
+            thunk.value = Variable( static_cast<const NumericBody &>( body ).value );
+            return Slot{ nullptr, &thunk.value };
+        case OperatorBody::constant:
+            return Slot{ nullptr, &static_cast<const ConstantBody &>( body ).value };
+        default:
+            thunk.body = &body;
+            thunk.frame = &frame;
+            return Slot{ &thunk, nullptr };
+    }
+}
+
+/* Raises again the failure of a thunk created by the current call. */
+[[noreturn]] void rethrow( const operand_failed & failure, const Thunk & a, const Thunk & b ) {
+    if( failure.thunk != &a && failure.thunk != &b )
+        throw failure;
+    std::rethrow_exception( failure.thunk->error );
+}
+
+Variable evaluate( const OperatorBody & body, const LazyFrame & frame ) {
+    switch( body.kind ) {
+        case OperatorBody::variable:
+            return frame[static_cast<const VariableBody &>( body ).slot].force();
+        case OperatorBody::numeric:
+            return Variable( static_cast<const NumericBody &>( body ).value );
+        case OperatorBody::constant:
+            return static_cast<const ConstantBody &>( body ).value;
+        case OperatorBody::pair: {
+            auto & pair = static_cast<const PairBody &>( body );
+            auto lvar = evaluate( *pair.first, frame );
+            auto rvar = evaluate( *pair.second, frame );
+            return Variable( lvar, rvar );
+        }
+        case OperatorBody::nullary:
+            return call( *static_cast<const NullaryTreeBody &>( body ).op );
+        case OperatorBody::unary: {
+            auto & tree = static_cast<const UnaryTreeBody &>( body );
+            Thunk thunk;
+            Slot variable = operand( *tree.variable, frame, thunk );
+            try {
+                return call( *tree.op, variable );
+            } catch( operand_failed & failure ) {
+                rethrow( failure, thunk, thunk );
+            }
+        }
+        case OperatorBody::binary: {
+            auto & tree = static_cast<const BinaryTreeBody &>( body );
+            Thunk left_thunk, right_thunk;
+            Slot left = operand( *tree.left, frame, left_thunk );
+            Slot right = operand( *tree.right, frame, right_thunk );
+            try {
+                return call( *tree.op, left, right );
+            } catch( operand_failed & failure ) {
+                rethrow( failure, left_thunk, right_thunk );
+            }
+        }
+        default:
+            break;
+    }
+
+    /* Native operations read a strict frame. */
+    Frame strict( frame.size() );
+    for( unsigned i = 0; i < frame.size(); ++i )
+        strict.bind( i, frame[i].force() );
+    return body.evaluate( strict );
+}
+
+} // anonymous namespace
+
+Variable evaluateLazily( const NullaryOperator & entry ) {
+    return call( entry );
+}
@@ -0,0 +1,50 @@
+/* lazy_evaluator.h
+ * Call-by-need evaluation of programs.
+ *
+ * The tree walker evaluates both operands of a call before selecting
+ * the overload, even if the overload never uses one of them, like
+ *
+ *  xfy 1100 0 && Y
+ *      0
+ *
+ * evaluateLazily passes the operands as thunks instead: a thunk is only
+ * evaluated (forced) when some pattern must inspect its value, or when
+ * a VariableBody bound to it is evaluated; its value is then kept for
+ * later uses. A parameter that is a plain variable, like Y above, binds
+ * the thunk without forcing it; other patterns force their argument.
+ * A variable that appears twice in the signature forces both arguments,
+ * to compare them. Pairs and the arguments of native operations are
+ * always forced.
+ *
+ * A thunk that fails when forced makes the call that created it fail,
+ * no matter how deep in other calls it was forced, as if it had failed
+ * before the call; the overloads in between are not retried. Thus, the
+ * result is the same as the tree walker's, unless some operand that is
+ * never forced would fail or never terminate; such programs succeed
+ * lazily. Since a failed operand may make the caller try another
+ * overload, such a program may even have a different result, like
+ *
+ *  fy 10 K X
+ *      1
+ *  fy 10 h X
+ *      K {{X, X} + 1}
+ *  fy 10 h X
+ *      7
+ *
+ * where 'h 5' is 1 lazily, but 7 otherwise. For the same reason,
+ * constant folding (that evaluates strictly) must not be used.
+ *
+ * Overload selection inspects arguments lazily, so it does not use
+ * the OverloadIndex; memoization (CallCache) is not supported.
+ */
+#ifndef LAZY_EVALUATOR_H
+#define LAZY_EVALUATOR_H
+
+#include "operator.h"
+#include "variable.h"
+
+/* Computes the value of the entry point with lazy operands.
+ * Raises semantic_error if the computation fails. */
+Variable evaluateLazily( const NullaryOperator & entry );
+
+#endif // LAZY_EVALUATOR_H
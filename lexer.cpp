@@ -1,7 +1,12 @@
 /* lexer.cpp
  * Implementation of lexer.h
  */
+#include <fcntl.h>
 #include <fstream>
+#include <iterator>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <lexertl/generator.hpp>
 #include <lexertl/lookup.hpp>
 
@@ -89,37 +94,47 @@ void Lexer::compute_next() {
     _next.column = _results.start.column();
 }
 
-Lexer::Lexer( const char * filename ) :
-    _file( new std::string )
-{
+void Lexer::start( std::size_t size ) {
     init();
 
-    std::ifstream in( filename, std::ios::in );
-    if( !in )
-        throw file_error("Error reading file");
-    in.seekg( 0, std::ios::end );
-    _file->resize( in.tellg() );
-    in.seekg( 0, std::ios::beg );
-    in.read( &(*_file)[0], _file->size() );
-    in.close();
-
-    position_iterator<std::string::iterator> iter( _file->begin() );
-    position_iterator<std::string::iterator> end( _file->end() );
+    position_iterator<const char *> iter( _data.get() );
+    position_iterator<const char *> end( _data.get() + size );
 
     _results = lexertl::match_results<decltype(iter)>( iter, end );
 
     compute_next();
 }
 
-Lexer::Lexer( std::string&& str ) :
-    _file( new std::string(std::move(str)) )
-{
-    init();
-
-    position_iterator<std::string::iterator> iter( _file->begin() );
-    position_iterator<std::string::iterator> end( _file->end() );
+Lexer::Lexer( const char * filename ) {
+    int fd = open( filename, O_RDONLY );
+    if( fd < 0 )
+        throw file_error("Error reading file");
+    struct stat status;
+    if( fstat( fd, &status ) == 0 && S_ISREG( status.st_mode ) && status.st_size > 0 ) {
+        std::size_t size = status.st_size;
+        void * address = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if( address != MAP_FAILED ) {
+            close( fd );
+            madvise( address, size, MADV_SEQUENTIAL );
+            _data.reset( static_cast<const char *>( address ),
+                    [size]( const char * data ){ munmap( (void *) data, size ); } );
+            start( size );
+            return;
+        }
+    }
+    close( fd );
 
-    _results = lexertl::match_results<decltype(iter)>( iter, end );
+    std::ifstream in( filename, std::ios::in | std::ios::binary );
+    if( !in )
+        throw file_error("Error reading file");
+    auto file = std::make_shared<std::string>(
+            std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() );
+    _data = std::shared_ptr<const char>( file, file->data() );
+    start( file->size() );
+}
 
-    compute_next();
+Lexer::Lexer( std::string&& str ) {
+    auto file = std::make_shared<std::string>( std::move(str) );
+    _data = std::shared_ptr<const char>( file, file->data() );
+    start( file->size() );
 }
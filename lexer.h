@@ -3,8 +3,13 @@
  * it is a model of JavaIterator.
  *
  * Although the lexing is done on demand, all the contents of the file are
- * read to a std::string on construction. This string is shared by
- * all the copies of the lexer.
+ * available from construction: the file is mapped to memory (read-only)
+ * and scanned in place, without being copied. Files that cannot be mapped,
+ * like pipes, are read to a std::string instead, as are the strings given
+ * to the second constructor. The characters are shared by all the copies
+ * of the lexer, and released with the last one.
+ *
+ * The file must not be truncated while mapped.
  */
 #ifndef LEXER_H
 #define LEXER_H
@@ -51,12 +56,15 @@ struct Lexer {
     }
 
 private:
-    std::shared_ptr<std::string> _file;
-    lexertl::match_results<position_iterator<std::string::iterator>> _results;
+    std::shared_ptr<const char> _data;
+    lexertl::match_results<position_iterator<const char *>> _results;
     Token _next;
 
     /* Computes the next token in the file and stores in Lexer::_next. */
     void compute_next();
+
+    /* Starts scanning the 'size' characters at _data. */
+    void start( std::size_t size );
 };
 
 #endif // LEXER_H
@@ -1,21 +1,40 @@
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include "bytecode.h"
+#include "call_cache.h"
+#include "constant_folding.h"
+#include "exceptions.h"
+#include "image.h"
+#include "inliner.h"
+#include "lazy_evaluator.h"
 #include "lexer.h"
 #include "native.h"
 #include "parser.h"
 #include "semantic_analyser.h"
 #include "symbol_table.h"
+#include "task_scheduler.h"
+#include "transpiler.h"
+#include "virtual_machine.h"
 
 #define LAMBDAOP(op) [](auto x, auto y){ return x op y; }
 
+/* Division by zero makes the overload invalid,
+ * instead of crashing the interpreter. */
+#define DIVISIONOP(op) [](auto x, auto y){ \
+        if( y == 0 ) \
+            throw semantic_error( "Division by zero" ); \
+        return x op y; \
+    }
+
 void insert_natives() {
     SymbolTable::insertCategory( "false" );
     SymbolTable::insertCategory( "true" );
-    insertNative( "__+", "xfy", 800, LAMBDAOP(+) );
-    insertNative( "__-", "xfy", 800, LAMBDAOP(-) );
-    insertNative( "__*", "xfy", 600, LAMBDAOP(*) );
-    insertNative( "__/", "xfy", 600, LAMBDAOP(/) );
-    insertNative( "__%", "xfy", 600, LAMBDAOP(%) );
+    insertNative( "__+", "xfy", 800, LAMBDAOP(+), "x + y" );
+    insertNative( "__-", "xfy", 800, LAMBDAOP(-), "x - y" );
+    insertNative( "__*", "xfy", 600, LAMBDAOP(*), "x * y" );
+    insertNative( "__/", "xfy", 600, DIVISIONOP(/), "x / divisor( y )" );
+    insertNative( "__%", "xfy", 600, DIVISIONOP(%), "x % divisor( y )" );
 }
 
 void lexical_analysis( const char * filename ) {
@@ -40,8 +59,8 @@ void syntactic_analysis( const char * filename ) {
         }
 }
 
-void semantic_analysis( const char * filename ) {
-    SemanticAnalyser semantic_analyser( std::make_unique<Parser>(filename) );
+void semantic_analysis( const char * filename, unsigned threads ) {
+    SemanticAnalyser semantic_analyser( std::make_unique<Parser>(filename), threads );
     while( semantic_analyser.has_next() )
         try {
             std::cout << *semantic_analyser.next() << '\n';
@@ -53,12 +72,34 @@ void semantic_analysis( const char * filename ) {
         }
 }
 
-void run_program( const char * filename ) {
-    SemanticAnalyser analyser( std::make_unique<Parser>(filename) );
+/* Options that change how the program is run. */
+struct RunOptions {
+    bool tree_walk = false;
+    unsigned threads = 1; // more than one implies tree_walk
+    bool lazy = false;
+    bool memoize = false;
+    std::size_t memo_limit = 64 << 20; // bytes
+    bool memo_stats = false;
+    unsigned inline_limit = 16; // nodes of the inlined bodies; 0 disables inlining
+    std::size_t fold_budget = 10000; // operator calls; 0 disables folding
+    unsigned analysis_threads = 1; // more than one analyses in two passes
+    const char * load = nullptr; // image to use instead of analysing the program
+};
+
+/* Analyses the whole program; 'sources' receives the files read,
+ * the program first. Returns false if the program has errors. */
+bool analyse_program( const char * filename, unsigned threads,
+        std::vector<std::string> & sources )
+{
+    SemanticAnalyser analyser( std::make_unique<Parser>(filename), threads );
+    sources.push_back( filename );
     bool errors = false;
     while( analyser.has_next() )
         try {
-            analyser.next();
+            auto statement = analyser.next();
+            if( statement->kind == Statement::include )
+                sources.push_back(
+                        static_cast<IncludeCommand&>(*statement).filename.lexeme.str() );
         } catch ( parse_error& ex ) {
             std::cerr << "Syntactic error: " << ex.what()
                       << ' ' << ex.where.line << ':' << ex.where.column << '\n';
@@ -68,12 +109,85 @@ void run_program( const char * filename ) {
             errors = true;
         }
 
-    if( errors ) {
+    if( errors )
         std::cerr << "Aborting due to programming errors.\n";
+    return !errors;
+}
+
+/* Analyses the whole program, or loads its image, and applies the
+ * optimizations enabled in the options. Returns false if the program
+ * has errors. */
+bool prepare_program( const char * filename, const RunOptions & options ) {
+    if( !options.load || !loadImage( options.load, filename ) ) {
+        if( options.load )
+            std::cerr << "Image " << options.load
+                      << " is stale or invalid; analysing the program.\n";
+        std::vector<std::string> sources;
+        if( !analyse_program( filename, options.analysis_threads, sources ) )
+            return false;
+    }
+
+    if( options.inline_limit > 0 )
+        inlineOperators( *SymbolTable::lastNullaryInserted(), options.inline_limit );
+    /* Folding evaluates strictly, which may differ from lazy evaluation. */
+    if( options.fold_budget > 0 && !options.lazy )
+        foldConstants( *SymbolTable::lastNullaryInserted(), options.fold_budget );
+    return true;
+}
+
+void run_program( const char * filename, const RunOptions & options ) {
+    if( !prepare_program( filename, options ) )
         return;
+
+    /* Every temporary value lives in the pool;
+     * only the final result is copied out of it.
+     * The lazy evaluator neither memoizes nor forks. */
+    std::unique_ptr<CallCache> cache;
+    if( options.memoize && !options.lazy )
+        cache = std::make_unique<CallCache>( options.memo_limit );
+
+    std::unique_ptr<TaskScheduler> scheduler;
+    if( options.threads > 1 && !options.lazy ) {
+        markForks( *SymbolTable::lastNullaryInserted() );
+        scheduler = std::make_unique<TaskScheduler>( options.threads );
     }
 
-    std::cout << *SymbolTable::lastNullaryInserted()->compute() << std::endl;
+    bool tree_walk = options.tree_walk || scheduler;
+    Bytecode program;
+    if( !tree_walk && !options.lazy )
+        program = compileProgram( *SymbolTable::lastNullaryInserted() );
+
+    Variable result;
+    {
+        VariablePool pool;
+        if( options.lazy )
+            result = pool.copy_out( evaluateLazily( *SymbolTable::lastNullaryInserted() ) );
+        else if( tree_walk )
+            result = pool.copy_out( SymbolTable::lastNullaryInserted()->compute() );
+        else
+            result = pool.copy_out( VirtualMachine( program ).run() );
+    }
+    std::cout << result << std::endl;
+
+    if( cache && options.memo_stats )
+        cache->report( std::cerr );
+}
+
+void compile_program( const char * filename, const RunOptions & options ) {
+    if( prepare_program( filename, options ) )
+        transpileProgram( *SymbolTable::lastNullaryInserted(), std::cout );
+}
+
+/* Analyses the program and writes its image (see image.h). */
+void compile_image( const char * filename, const char * image, const RunOptions & options ) {
+    std::vector<std::string> sources;
+    if( !analyse_program( filename, options.analysis_threads, sources ) )
+        return;
+    try {
+        writeImage( image, *SymbolTable::lastNullaryInserted(), sources );
+    } catch ( file_error & ex ) {
+        std::cerr << ex.what() << ' ' << image << '\n';
+    }
 }
 
 void interactive() {
@@ -82,8 +196,10 @@ void interactive() {
     while( std::getline(std::cin, str) )
         try {
             auto pair = parse_single_line( str );
-            if( pair.second )
-                std::cout << *pair.second->evaluate( VariableTable() ) << std::endl;
+            if( pair.second ) {
+                VariablePool pool;
+                std::cout << pair.second->evaluate( Frame() ) << std::endl;
+            }
             if( pair.first )
                 while( pair.first->has_next() )
                     pair.first->next();
@@ -92,6 +208,17 @@ void interactive() {
         }
 }
 
+bool is_option( const char * arg, const char * short_name, const char * long_name ) {
+    return strcmp(arg, short_name) == 0 || strcmp(arg, long_name) == 0;
+}
+
+void usage( const char * program ) {
+    std::cout << "Usage: " << program << " [-l | -p | -s | -r | -c] [-t] [-j <N>] [--lazy] [-m] [--memo-limit <MiB>]"
+                 " [--memo-stats] [--inline-limit <N>]"
+                 " [--fold-budget <N>] [--analysis-threads <N>]"
+                 " [--compile-to <image> | --load <image>] <filename>\n";
+}
+
 int main( int argc, char * argv[] ) {
     insert_natives();
 
@@ -100,47 +227,112 @@ int main( int argc, char * argv[] ) {
         return 0;
     }
 
-    if( argc == 2 ) {
-        if( strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0 ) {
-            std::cout << "Usage: " << argv[0] << " [-l | -p | -s | -r] <filename>\n"
-                         "\n"
-                         "This program will analyse the program specified in the last argument.\n"
-                         "  -l, --lexer     Do lexical analysis on the program.\n"
-                         "  -p, --parser    Do syntactic analysis on the program.\n"
-                         "  -s, --semantic  Do semantical analysis on the program.\n"
-                         "  -r, --run       Run the program. This is the default.\n"
-                         "  -h, --help      Display this help and quit.\n"
-                         "If no argument is provided, run in interactive mode.\n";
-            return 0;
-        }
-        run_program( argv[1] );
+    if( argc == 2 && is_option(argv[1], "-h", "--help") ) {
+        usage( argv[0] );
+        std::cout << "\n"
+                     "This program will analyse the program specified in the last argument.\n"
+                     "  -l, --lexer     Do lexical analysis on the program.\n"
+                     "  -p, --parser    Do syntactic analysis on the program.\n"
+                     "  -s, --semantic  Do semantical analysis on the program.\n"
+                     "  -r, --run       Run the program. This is the default.\n"
+                     "  -c, --compile   Translate the program to C++, written to the\n"
+                     "                  standard output (see transpiler.h).\n"
+                     "  -t, --tree-walk Run the program by walking the syntax tree,\n"
+                     "                  instead of compiling it to bytecode.\n"
+                     "  -j, --threads N Run the program on N threads, walking the syntax\n"
+                     "                  tree (see task_scheduler.h; default: 1).\n"
+                     "  --lazy          Evaluate operands only when they are needed\n"
+                     "                  (see lazy_evaluator.h). Disables constant folding,\n"
+                     "                  and ignores -t, -j and -m.\n"
+                     "  -m, --memoize   Cache the results of operator calls while running.\n"
+                     "  --memo-limit N  Use at most N MiB for the cache (default: 64).\n"
+                     "  --memo-stats    Print the cache hits and misses of each operator.\n"
+                     "  --inline-limit N\n"
+                     "                  Inline the calls to operators whose bodies have at\n"
+                     "                  most N nodes (default: 16; 0 disables).\n"
+                     "  --fold-budget N Evaluate the subexpressions without variables before\n"
+                     "                  running, with at most N operator calls each\n"
+                     "                  (default: 10000; 0 disables).\n"
+                     "  --analysis-threads N\n"
+                     "                  Build the bodies of the operators on N threads,\n"
+                     "                  after reading the whole program (see\n"
+                     "                  semantic_analyser.h; default: 1).\n"
+                     "  --compile-to F  Analyse the program and write its image to the\n"
+                     "                  file F, instead of running it (see image.h).\n"
+                     "  --load F        Run the program from the image in the file F;\n"
+                     "                  if the image is stale, analyse the program.\n"
+                     "  -h, --help      Display this help and quit.\n"
+                     "If no argument is provided, run in interactive mode.\n";
         return 0;
     }
 
-    if( argc != 3 ) {
-        std::cout << "Usage: " << argv[0] << " [-l | -p | -s | -r] <filename>\n";
-        return 1;
+    char mode = 'r';
+    RunOptions options;
+    const char * image = nullptr;
+    for( int i = 1; i < argc - 1; ++i ) {
+        if( is_option(argv[i], "-l", "--lexer") )
+            mode = 'l';
+        else if( is_option(argv[i], "-p", "--parser") )
+            mode = 'p';
+        else if( is_option(argv[i], "-s", "--semantic") )
+            mode = 's';
+        else if( is_option(argv[i], "-r", "--run") )
+            mode = 'r';
+        else if( is_option(argv[i], "-c", "--compile") )
+            mode = 'c';
+        else if( is_option(argv[i], "-t", "--tree-walk") )
+            options.tree_walk = true;
+        else if( is_option(argv[i], "-j", "--threads") && i + 1 < argc - 1 )
+            options.threads = std::strtoul( argv[++i], nullptr, 10 );
+        else if( strcmp(argv[i], "--lazy") == 0 )
+            options.lazy = true;
+        else if( is_option(argv[i], "-m", "--memoize") )
+            options.memoize = true;
+        else if( strcmp(argv[i], "--memo-limit") == 0 && i + 1 < argc - 1 )
+            options.memo_limit = std::strtoull( argv[++i], nullptr, 10 ) << 20;
+        else if( strcmp(argv[i], "--memo-stats") == 0 )
+            options.memo_stats = true;
+        else if( strcmp(argv[i], "--inline-limit") == 0 && i + 1 < argc - 1 )
+            options.inline_limit = std::strtoul( argv[++i], nullptr, 10 );
+        else if( strcmp(argv[i], "--fold-budget") == 0 && i + 1 < argc - 1 )
+            options.fold_budget = std::strtoull( argv[++i], nullptr, 10 );
+        else if( strcmp(argv[i], "--analysis-threads") == 0 && i + 1 < argc - 1 )
+            options.analysis_threads = std::strtoul( argv[++i], nullptr, 10 );
+        else if( strcmp(argv[i], "--compile-to") == 0 && i + 1 < argc - 1 ) {
+            mode = 'i';
+            image = argv[++i];
+        }
+        else if( strcmp(argv[i], "--load") == 0 && i + 1 < argc - 1 )
+            options.load = argv[++i];
+        else {
+            std::cerr << "Unknown option " << argv[i] << '\n';
+            usage( argv[0] );
+            return 1;
+        }
     }
 
-    const char * filename = argv[2];
-    if( strcmp(argv[1], "-l" ) == 0 || strcmp(argv[1], "--lexer") == 0 ) {
-        lexical_analysis( filename );
-        return 0;
-    }
-    if( strcmp(argv[1], "-p" ) == 0 || strcmp(argv[1], "--parser") == 0 ) {
-        syntactic_analysis( filename );
-        return 0;
-    }
-    if( strcmp(argv[1], "-s" ) == 0 || strcmp(argv[1], "--semantic") == 0 ) {
-        semantic_analysis( filename );
-        return 0;
-    }
-    if( strcmp(argv[1], "-r" ) == 0 || strcmp(argv[1], "--run") == 0 ) {
-        run_program( filename );
-        return 0;
-    }
+    if( options.lazy && (options.threads > 1 || options.memoize) )
+        std::cerr << "Warning: --lazy ignores -j and -m.\n";
 
-    std::cerr << "Unknown option " << argv[1] << '\n';
-    return 1;
+    const char * filename = argv[argc - 1];
+    switch( mode ) {
+        case 'l':
+            lexical_analysis( filename );
+            return 0;
+        case 'p':
+            syntactic_analysis( filename );
+            return 0;
+        case 's':
+            semantic_analysis( filename, options.analysis_threads );
+            return 0;
+        case 'c':
+            compile_program( filename, options );
+            return 0;
+        case 'i':
+            compile_image( filename, image, options );
+            return 0;
+        default:
+            run_program( filename, options );
+            return 0;
+    }
 }
-
@@ -0,0 +1,51 @@
+/* name.cpp
+ * Implementation of name.h.
+ */
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include "name.h"
+
+namespace {
+    /* The strings are the keys of 'ids', whose addresses are stable. */
+    struct Table {
+        std::unordered_map<std::string, unsigned> ids;
+        std::vector<const std::string *> strings;
+
+        Table() {
+            intern( "" );
+        }
+
+        unsigned intern( const std::string & str ) {
+            auto iter = ids.find( str );
+            if( iter != ids.end() )
+                return iter->second;
+            iter = ids.emplace( str, strings.size() ).first;
+            strings.push_back( &iter->first );
+            return iter->second;
+        }
+    };
+
+    /* Constructed on first use, since names may be created
+     * during the initialization of other static objects. */
+    Table & table() {
+        static Table table;
+        return table;
+    }
+} // anonymous namespace
+
+Name::Name( const std::string & str ) :
+    _id( table().intern(str) )
+{}
+
+Name::Name( const char * str ) :
+    Name( std::string(str) )
+{}
+
+const std::string & Name::str() const {
+    return *table().strings[_id];
+}
+
+std::ostream& operator<<( std::ostream& os, Name name ) {
+    return os << name.str();
+}
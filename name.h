@@ -0,0 +1,56 @@
+/* name.h
+ * Interned strings.
+ *
+ * Every lexeme read by the Lexer is interned in a process-wide table:
+ * a Name holds only the index of its string in the table, so names are
+ * compared and hashed as integers, and each distinct string is stored
+ * once, no matter how many tokens, symbols and variables refer to it.
+ * The string itself is only needed for printing and error messages.
+ *
+ * Equal names have equal ids. The ordering, however, is the one of
+ * the strings, so that it does not depend on the interning order.
+ *
+ * Creating a Name from a string is not thread-safe: names are created
+ * while reading the program (see semantic_analyser.h); the threads of
+ * the analysis and of the evaluation only copy and compare them.
+ */
+#ifndef NAME_H
+#define NAME_H
+
+#include <cstddef>
+#include <functional>
+#include <iosfwd>
+#include <string>
+
+class Name {
+    unsigned _id;
+
+public:
+    /* The empty string. */
+    Name() : _id( 0 ) {}
+
+    /* Interns the string. */
+    Name( const std::string & );
+    Name( const char * );
+
+    unsigned id() const { return _id; }
+    const std::string & str() const;
+    const char * c_str() const { return str().c_str(); }
+};
+
+inline bool operator==( Name lhs, Name rhs ) { return lhs.id() == rhs.id(); }
+inline bool operator!=( Name lhs, Name rhs ) { return lhs.id() != rhs.id(); }
+inline bool operator< ( Name lhs, Name rhs ) { return lhs.str() <  rhs.str(); }
+inline bool operator> ( Name lhs, Name rhs ) { return lhs.str() >  rhs.str(); }
+inline bool operator<=( Name lhs, Name rhs ) { return lhs.str() <= rhs.str(); }
+inline bool operator>=( Name lhs, Name rhs ) { return lhs.str() >= rhs.str(); }
+
+std::ostream& operator<<( std::ostream&, Name );
+
+namespace std {
+    template<> struct hash<Name> {
+        std::size_t operator()( Name name ) const { return name.id(); }
+    };
+} // namespace std
+
+#endif // NAME_H
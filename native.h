@@ -9,45 +9,71 @@
 #include "symbol_table.h"
 
 struct NativeOperation : public OperatorBody {
-    virtual std::unique_ptr<Variable> evaluate( const VariableTable& ) const = 0;
+    NativeOperation() : OperatorBody( native ) {}
+    virtual Variable evaluate( const Frame& ) const = 0;
     virtual ~NativeOperation() = default;
     virtual NativeOperation * clone() const override = 0;
 };
 
+/* Native operations that compute a number from two numbers.
+ * When such an operation is the only overload of its operator, the
+ * virtual machine calls 'apply' directly with the arguments of the
+ * call, without selecting the overload nor building a frame. */
+struct NativeBinaryNumericOperation : public NativeOperation {
+    virtual long long apply( long long, long long ) const = 0;
+
+    /* C++ expression equivalent to 'apply', over the variables x and y;
+     * it is used by the transpiler (see transpiler.h). */
+    virtual const std::string & source() const = 0;
+
+    virtual NativeBinaryNumericOperation * clone() const override = 0;
+};
+
 /* Template for binary numeric operations.
  * This class assumes either xfx, xfy or yfx format and variables
- * {X} and {Y}. */
+ * {X} and {Y}, in the slots 0 and 1. */
 template< typename Functor >
-struct NativeBinaryNumericOperator : public NativeOperation {
+struct NativeBinaryNumericOperator : public NativeBinaryNumericOperation {
     Functor f;
     std::string name;
+    std::string code;
 
-    NativeBinaryNumericOperator( Functor f, std::string name ): f(f), name(name) {}
+    NativeBinaryNumericOperator( Functor f, std::string name, std::string code ):
+        f(f), name(name), code(code)
+    {}
 
-    virtual std::unique_ptr<Variable> evaluate( const VariableTable& table ) const override {
-        auto X = table.retrieve("X");
-        auto Y = table.retrieve("Y");
-        return std::make_unique<Variable>( f(X->value, Y->value) );
+    virtual long long apply( long long x, long long y ) const override {
+        return f( x, y );
+    }
+    virtual const std::string & source() const override {
+        return code;
+    }
+    virtual Variable evaluate( const Frame& frame ) const override {
+        return Variable( apply(frame[0].value(), frame[1].value()) );
     }
     virtual NativeBinaryNumericOperator * clone() const override {
-        return new NativeBinaryNumericOperator{ f, name };
+        return new NativeBinaryNumericOperator{ f, name, code };
     }
     virtual std::ostream& print_to( std::ostream& os ) const override {
         return os << "{Native " << name << "}";
     }
 };
 
+/* 'source' is the C++ expression equivalent to f (see above). */
 template< typename Functor >
-void insertNative( std::string name, std::string format, unsigned priority, Functor f ) {
+void insertNative( std::string name, std::string format, unsigned priority,
+        Functor f, std::string source )
+{
     Token X, Y;
     X.lexeme = "X";
     Y.lexeme = "Y";
     auto ptr = std::make_unique<BinaryOverload>(
             name,
-            std::make_unique<NativeBinaryNumericOperator<Functor>>(f, name),
-            std::make_unique<RestrictedParameter>(X),
-            std::make_unique<RestrictedParameter>(Y)
+            std::make_unique<NativeBinaryNumericOperator<Functor>>(f, name, source),
+            std::make_unique<RestrictedParameter>(X, 0),
+            std::make_unique<RestrictedParameter>(Y, 1)
         );
+    ptr->frame_size = 2;
     SymbolTable::insertOverload( name, format, priority, std::move(ptr) );
 }
 
@@ -11,20 +11,17 @@ std::ostream& NullaryOverload::print_to( std::ostream& os ) const {
 NullaryOverload * NullaryOverload::clone() const {
     return new NullaryOverload( name, body->clone() );
 }
-std::unique_ptr<Variable> NullaryOverload::compute() const {
-    return body->evaluate( VariableTable() );
-}
 
 std::ostream& UnaryOverload::print_to( std::ostream& os ) const {
     return os << "{{UnaryOverload} " << name << "\n" << *variable << "\n" << *body << "\n}";
 }
 UnaryOverload * UnaryOverload::clone() const {
-    return new UnaryOverload( name, body->clone(), variable->clone() );
+    auto ptr = new UnaryOverload( name, body->clone(), variable->clone() );
+    ptr->frame_size = frame_size;
+    return ptr;
 }
-std::unique_ptr<Variable> UnaryOverload::compute( std::unique_ptr<Variable>&& var ) const {
-    VariableTable table;
-    variable->decompose( *var, table );
-    return body->evaluate( table );
+bool UnaryOverload::match( Frame& frame, const Variable& var ) const {
+    return variable->try_decompose( var, frame );
 }
 
 std::ostream& BinaryOverload::print_to( std::ostream& os ) const {
@@ -32,15 +29,16 @@ std::ostream& BinaryOverload::print_to( std::ostream& os ) const {
                                     << *right << "\n" << *body << "\n}";
 }
 BinaryOverload * BinaryOverload::clone() const {
-    return new BinaryOverload( name, body->clone(), left->clone(), right->clone() );
-}
-std::unique_ptr<Variable> BinaryOverload::compute(
-        std::unique_ptr<Variable>&& left_var,
-        std::unique_ptr<Variable>&& right_var
+    auto ptr = new BinaryOverload( name, body->clone(), left->clone(), right->clone() );
+    ptr->frame_size = frame_size;
+    return ptr;
+}
+bool BinaryOverload::match(
+        Frame& frame,
+        const Variable& left_var,
+        const Variable& right_var
     ) const
 {
-    VariableTable table;
-    left->decompose( *left_var, table );
-    right->decompose( *right_var, table );
-    return body->evaluate( table );
+    return left->try_decompose( left_var, frame ) &&
+           right->try_decompose( right_var, frame );
 }
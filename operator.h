@@ -10,7 +10,9 @@
 #define OPERATOR_H
 
 #include "ast.h"
+#include "call_cache.h"
 #include "exceptions.h"
+#include "overload_index.h"
 #include "printable.h"
 #include "symbol.h"
 
@@ -34,21 +36,32 @@
  * Note that there is no need of differentiating beetween prefix
  * and postfix: each node has a pointer to its version of the operator.
  *
- * The evaluation of each overload is done by calling a method
- * named 'compute' in each class, that have a signature according
- * to its type.
- * The method 'compute' first decompose the variable using the 'decompose'
- * method from the classes below OperatorParameter. These methods might
- * fail; in this case, a semantic_error is thrown.
+ * Overload selection is done by calling a method named 'match' in
+ * each class, that have a signature according to its type.
+ * The method 'match' decompose the variables using the 'try_decompose'
+ * method from the classes below OperatorParameter, into a Frame with
+ * frame_size slots, and returns false if they do not match the pattern.
+ * The body is then evaluated over the populated frame.
+ *
+ * The method 'keys' returns the PatternKey of each parameter,
+ * used by the operator to index its overloads.
+ *
+ * The arguments are only borrowed: the frame refers to their subtrees
+ * in place, so a successful match copies nothing and a failed match
+ * leaves the arguments untouched for the next overload.
  */
 struct OperatorOverload : public Statement {
-    OperatorOverload() = default;
+    OperatorOverload() : Statement( overload ) {}
     OperatorOverload( auto&& n, auto&& b ) :
+        Statement( overload ),
         name( AUX_FORWARD(n) ),
         body( AUX_FORWARD(b) )
     {}
-    std::string name;
+    Name name;
     std::unique_ptr<OperatorBody> body;
+    /* Number of distinct variable names in the signature;
+     * each call allocates a Frame with this many slots. */
+    unsigned frame_size = 0;
     /* Class invariant: the only instances in the tree below
      * 'body' are TreeNodeBody, NumericBody, VariableBody
      * and PairBody. In particular, TerminalBody and SequenceBody
@@ -64,7 +77,9 @@ struct NullaryOverload : public OperatorOverload {
     NullaryOverload( auto&& n, auto&& b ) :
         OperatorOverload( AUX_FORWARD(n), AUX_FORWARD(b) )
     {}
-    std::unique_ptr<Variable> compute() const;
+    static const unsigned arity = 0;
+    bool match( Frame& ) const { return true; }
+    std::vector<PatternKey> keys() const { return {}; }
     virtual std::ostream& print_to( std::ostream& ) const override;
     virtual NullaryOverload * clone() const override;
 };
@@ -76,7 +91,9 @@ struct UnaryOverload : public OperatorOverload {
         variable( AUX_FORWARD(v) )
     {}
     std::unique_ptr<OperatorParameter> variable;
-    std::unique_ptr<Variable> compute( std::unique_ptr<Variable>&& ) const;
+    static const unsigned arity = 1;
+    bool match( Frame&, const Variable& ) const;
+    std::vector<PatternKey> keys() const { return { variable->key() }; }
     virtual std::ostream& print_to( std::ostream& ) const override;
     virtual UnaryOverload * clone() const override;
 };
@@ -89,23 +106,40 @@ struct BinaryOverload : public OperatorOverload {
     {}
     std::unique_ptr<OperatorParameter> left;
     std::unique_ptr<OperatorParameter> right;
-    std::unique_ptr<Variable> compute(
-            std::unique_ptr<Variable>&& left,
-            std::unique_ptr<Variable>&& right ) const;
+    static const unsigned arity = 2;
+    bool match( Frame&, const Variable& left, const Variable& right ) const;
+    std::vector<PatternKey> keys() const { return { left->key(), right->key() }; }
     virtual std::ostream& print_to( std::ostream& ) const override;
     virtual BinaryOverload * clone() const override;
 };
 
 /* Finally, we can construct Operators as sets of Overloads.
  *
- * Each operator have a 'compute' method, analog to its
- * Overload counterpart. Here, the operator attempts each
- * overload in insertion order until some operator correctly
+ * Each operator have a 'compute' method. Here, the operator attempts
+ * each overload in insertion order until some operator correctly
  * returns, or raises an exception (a semantic_error) if
- * no valid overload is found. */
+ * no valid overload is found.
+ *
+ * Overloads whose top-level patterns cannot accept the arguments are
+ * skipped altogether: the operator keeps an OverloadIndex, updated at
+ * each insertion, that lists only the candidates, still in insertion order.
+ *
+ * Patterns that do not match are rejected without exceptions.
+ * An overload whose pattern matches but whose body raises a
+ * semantic_error (because some inner call found no valid overload)
+ * is also considered invalid, and the search continues.
+ *
+ * The operator takes ownership of the arguments (they are moved
+ * into 'compute'), and lends them to each overload in turn.
+ *
+ * If a CallCache is active, unary and binary operators memoize
+ * their results in it (see call_cache.h). */
 template <typename Overload>
 struct OperatorBase : public Symbol {
-    OperatorBase( std::string name ) : Symbol( name ) {}
+    OperatorBase( Name name ) :
+        Symbol( name ),
+        index( Overload::arity )
+    {}
     std::vector<std::unique_ptr<Overload>> overloads;
     void insert( std::unique_ptr<OperatorOverload>&& overload ) {
         Overload * ptr = &dynamic_cast<Overload&>( *overload );
@@ -113,51 +147,67 @@ struct OperatorBase : public Symbol {
         /* We needed to do this in two steps in order to not leak
          * memory if the cast throws an exception. */
         overloads.emplace_back( ptr );
+        index.insert( ptr->keys(), overloads.size() - 1 );
     }
     unsigned priority;
 
+    /* Overloads that may accept the arguments, in insertion order. */
+    template< typename ... Args >
+    const std::vector<unsigned>& candidates( const Args & ... args ) const {
+        return index.candidates( args... );
+    }
+
 protected:
+    OverloadIndex index;
+
     /* This protected function factors the brute-force out of
      * the respective methods in derived classes.
      *
      * We don't expose this function directly to help with
      * compiler error messages. */
     template< typename ... Args >
-    std::unique_ptr<Variable> _compute( Args && ... args ) const {
-        for( const auto& ptr : overloads )
+    Variable _compute( const Args & ... args ) const {
+        for( unsigned i : candidates( args... ) ) {
+            const auto& ptr = overloads[i];
+            Frame frame( ptr->frame_size );
+            if( !ptr->match( frame, args... ) )
+                continue;
             try {
-                return ptr->compute( std::forward<Args>(args)... );
+                return ptr->body->evaluate( frame );
             } catch( semantic_error & ) {
                 // Found invalid overload.
             }
+        }
 
         throw semantic_error( "No valid overload found" );
     }
 };
 
 struct NullaryOperator : public OperatorBase<NullaryOverload> {
-    std::unique_ptr<Variable> compute();
-    NullaryOperator( std::string name ) : OperatorBase<NullaryOverload>( name ) {}
-    std::unique_ptr<Variable> compute() const {
+    NullaryOperator( Name name ) : OperatorBase<NullaryOverload>( name ) {}
+    Variable compute() const {
         return _compute();
     }
 };
 struct UnaryOperator : public OperatorBase<UnaryOverload> {
-    UnaryOperator( std::string name ) : OperatorBase<UnaryOverload>( name ) {}
+    UnaryOperator( Name name ) : OperatorBase<UnaryOverload>( name ) {}
     unsigned operand_priority;
-    std::unique_ptr<Variable> compute( std::unique_ptr<Variable>&& var ) const {
-        return _compute( std::move(var) );
+    Variable compute( Variable var ) const {
+        if( !CallCache::active )
+            return _compute( var );
+        return CallCache::active->memoize( *this, var, Variable(),
+                [&]{ return _compute( var ); } );
     }
 };
 struct BinaryOperator : public OperatorBase<BinaryOverload> {
-    BinaryOperator( std::string name ) : OperatorBase<BinaryOverload>( name ) {}
+    BinaryOperator( Name name ) : OperatorBase<BinaryOverload>( name ) {}
     unsigned left_priority;
     unsigned right_priority;
-    std::unique_ptr<Variable> compute(
-            std::unique_ptr<Variable>&& left,
-            std::unique_ptr<Variable>&& right ) const
-    {
-        return _compute( std::move(left), std::move(right) );
+    Variable compute( Variable left, Variable right ) const {
+        if( !CallCache::active )
+            return _compute( left, right );
+        return CallCache::active->memoize( *this, left, right,
+                [&]{ return _compute( left, right ); } );
     }
 };
 
@@ -0,0 +1,101 @@
+/* overload_index.cpp
+ * Implementation of overload_index.h
+ */
+#include "overload_index.h"
+
+OverloadIndex::OverloadIndex( unsigned arity ) :
+    depth( arity )
+{
+    make( 0 );
+}
+
+unsigned OverloadIndex::make( unsigned level ) {
+    unsigned node = nodes.size();
+    nodes.emplace_back();
+    if( level < depth ) {
+        unsigned numbers = make( level + 1 );
+        unsigned pairs = make( level + 1 );
+        nodes[node].numbers = numbers;
+        nodes[node].pairs = pairs;
+    }
+    return node;
+}
+
+unsigned OverloadIndex::copy( unsigned source, unsigned level ) {
+    unsigned node = nodes.size();
+    nodes.emplace_back();
+    nodes[node].candidates = nodes[source].candidates;
+    if( level < depth ) {
+        unsigned numbers = copy( nodes[source].numbers, level + 1 );
+        unsigned pairs = copy( nodes[source].pairs, level + 1 );
+        std::unordered_map<long long, unsigned> literals;
+        for( const auto& pair : nodes[source].literals )
+            literals.emplace( pair.first, 0 );
+        for( auto& pair : literals )
+            pair.second = copy( nodes[source].literals.at(pair.first), level + 1 );
+        nodes[node].numbers = numbers;
+        nodes[node].pairs = pairs;
+        nodes[node].literals = std::move( literals );
+    }
+    return node;
+}
+
+void OverloadIndex::add(
+        unsigned node,
+        unsigned level,
+        const PatternKey * keys,
+        unsigned overload )
+{
+    if( level == depth ) {
+        nodes[node].candidates.push_back( overload );
+        return;
+    }
+
+    switch( keys[level].kind ) {
+        case PatternKey::any:
+            add( nodes[node].pairs, level + 1, keys, overload );
+            // fall through
+        case PatternKey::number: {
+            /* The recursive calls may reallocate 'nodes',
+             * so the children are collected beforehand. */
+            std::vector<unsigned> children{ nodes[node].numbers };
+            for( const auto& pair : nodes[node].literals )
+                children.push_back( pair.second );
+            for( unsigned child : children )
+                add( child, level + 1, keys, overload );
+            return;
+        }
+
+        case PatternKey::literal: {
+            auto it = nodes[node].literals.find( keys[level].value );
+            if( it == nodes[node].literals.end() ) {
+                unsigned child = copy( nodes[node].numbers, level + 1 );
+                it = nodes[node].literals.emplace( keys[level].value, child ).first;
+            }
+            add( it->second, level + 1, keys, overload );
+            return;
+        }
+
+        case PatternKey::pair:
+            add( nodes[node].pairs, level + 1, keys, overload );
+            return;
+    }
+}
+
+void OverloadIndex::insert( const std::vector<PatternKey>& keys, unsigned overload ) {
+    add( 0, 0, keys.data(), overload );
+}
+
+const std::vector<unsigned>& OverloadIndex::find( const Variable * const * vars ) const {
+    const Node * node = &nodes[0];
+    for( unsigned level = 0; level < depth; ++level ) {
+        const Variable& var = *vars[level];
+        if( var.is_pair() ) {
+            node = &nodes[node->pairs];
+            continue;
+        }
+        auto it = node->literals.find( var.value() );
+        node = &nodes[ it == node->literals.end() ? node->numbers : it->second ];
+    }
+    return node->candidates;
+}
@@ -0,0 +1,62 @@
+/* overload_index.h
+ * Discrimination tree used to select the overloads of an operator.
+ *
+ * Each overload signature is summarized by one PatternKey per argument,
+ * that describes which values its top-level pattern may accept.
+ * The index branches on each argument in turn: pairs go to one child,
+ * and numbers go to the child of its literal value (found through a
+ * hash table) or, if no pattern mentions that value, to a common child.
+ * After the last argument, the leaf lists every overload whose keys
+ * accept the arguments that lead there, in insertion order.
+ *
+ * Thus, the candidates of a call are found in time proportional to the
+ * arity, and first-match semantics is preserved by trying the candidates
+ * in the order they are listed. The candidates still need to be matched
+ * against the full pattern, since only the top level is indexed.
+ *
+ * The index is updated incrementally: a literal seen for the first time
+ * receives a copy of the common child, and every later key that accepts
+ * arbitrary numbers is added both to the common child and to each literal.
+ */
+#ifndef OVERLOAD_INDEX_H
+#define OVERLOAD_INDEX_H
+
+#include <unordered_map>
+#include <vector>
+#include "ast.h"
+#include "variable.h"
+
+class OverloadIndex {
+    struct Node {
+        std::vector<unsigned> candidates; // Used only in the leaves.
+        std::unordered_map<long long, unsigned> literals;
+        unsigned numbers; // Numbers without a literal of their own.
+        unsigned pairs;
+    };
+    std::vector<Node> nodes; // nodes[0] is the root.
+    unsigned depth;
+
+    unsigned make( unsigned level );
+    unsigned copy( unsigned node, unsigned level );
+    void add( unsigned node, unsigned level, const PatternKey * keys, unsigned overload );
+    const std::vector<unsigned>& find( const Variable * const * vars ) const;
+
+public:
+    /* Constructs an empty index for operators with 'arity' arguments. */
+    explicit OverloadIndex( unsigned arity );
+
+    /* Registers the overload with the given keys (one per argument).
+     * The overload number must be greater than every number
+     * previously inserted. */
+    void insert( const std::vector<PatternKey>& keys, unsigned overload );
+
+    /* Returns the overloads that may accept the arguments,
+     * in insertion order. */
+    template< typename ... Args >
+    const std::vector<unsigned>& candidates( const Args& ... args ) const {
+        const Variable * vars[] = { &args..., nullptr };
+        return find( vars );
+    }
+};
+
+#endif // OVERLOAD_INDEX_H
@@ -37,6 +37,7 @@ namespace {
 } // anonymous namespace
 
 Parser::Parser( const char * filename ) :
+    _filename( filename ),
     _alex( filename ),
     _next( nullptr )
 {}
@@ -46,6 +47,10 @@ Parser::Parser( std::string&& str ) :
     _next( nullptr )
 {}
 
+const std::string & Parser::filename() const {
+    return _filename;
+}
+
 std::unique_ptr<Statement> Parser::next() {
     if( !_next )
         compute_next();
@@ -118,7 +123,7 @@ std::unique_ptr<CategoryDefinition> parse_category( Lexer& alex ) {
 
 std::unique_ptr<OperatorDefinition> parse_operator( Lexer& alex ) {
     auto ptr = std::make_unique<OperatorDefinition>();
-    ptr->format = alex.next().lexeme;
+    ptr->format = alex.next().lexeme.str();
 
     if( alex.peek().id != Token::NUM ) throw parse_error( "Expected priority", alex.peek() );
     ptr->priority = std::atoi(alex.next().lexeme.c_str());
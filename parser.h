@@ -32,7 +32,11 @@ struct Parser {
     /* Error-recovering mode. */
     void panic();
 
+    /* Name of the parsed file; empty if parsing a string. */
+    const std::string & filename() const;
+
 private:
+    std::string _filename;
     Lexer _alex;
     std::unique_ptr<Statement> _next;
     void compute_next();
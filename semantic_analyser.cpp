@@ -1,13 +1,90 @@
 /* semantic_analyser.cpp
  * Implementation of semantic_analyser.h
  */
+#include <atomic>
+#include <sys/stat.h>
+#include <thread>
 #include "tree_build.h"
 #include "operator.h"
 #include "semantic_analyser.h"
 #include "symbol_table.h"
 
+namespace {
+    std::unique_ptr<OperatorOverload> build_overload( const OperatorDefinition & def ) {
+        if( def.format == "f" )
+            return buildNullaryTree( def );
+        else if( def.format == "fx"
+              || def.format == "fy"
+              || def.format == "xf"
+              || def.format == "yf" )
+            return buildUnaryTree( def );
+        else
+            return buildBinaryTree( def );
+    }
+
+    /* The name of the operator; see tree_build.cpp. */
+    Name operator_name( const OperatorDefinition & def ) {
+        unsigned index = def.format[0] == 'f' ? 0 : 1;
+        return static_cast<const OperatorName&>(*def.names[index]).name.lexeme;
+    }
+} // anonymous namespace
+
 SemanticAnalyser::SemanticAnalyser( std::unique_ptr<Parser>&& parser ) {
+    /* The program itself must not be included again. */
+    struct stat status;
+    if( !parser->filename().empty() && stat( parser->filename().c_str(), &status ) == 0 )
+        included().insert( FileId( status.st_dev, status.st_ino ) );
     parser_stack.emplace( std::move(parser) );
+    pop_finished();
+}
+
+SemanticAnalyser::SemanticAnalyser( std::unique_ptr<Parser>&& parser, unsigned threads ) :
+    SemanticAnalyser( std::move(parser) )
+{
+    if( threads <= 1 )
+        return;
+    two_pass = speculative = true;
+
+    // First pass: read the statements and declare the operators.
+    while( !parser_stack.empty() ) {
+        entries.emplace_back();
+        Entry & entry = entries.back();
+        entry.index = entries.size();
+        SymbolTable::hideFrom( entry.index );
+        try {
+            entry.statement = read( entry.index );
+            if( entry.statement->kind == Statement::definition ) {
+                auto & def = static_cast<OperatorDefinition&>(*entry.statement);
+                entry.declares = SymbolTable::declareOperator(
+                        operator_name(def), def.format, def.priority, entry.index );
+            }
+        } catch( parse_error & ) {
+            entry.error = std::current_exception();
+        } catch( ... ) {
+            /* The sequential analysis would stop here. */
+            entry.error = std::current_exception();
+            break;
+        }
+    }
+    SymbolTable::hideFrom( -1 );
+
+    // Second pass: build the bodies.
+    std::vector<Entry *> definitions;
+    for( auto & entry : entries )
+        if( entry.statement && entry.statement->kind == Statement::definition )
+            definitions.push_back( &entry );
+
+    std::atomic<std::size_t> next_definition{0};
+    auto work = [&]() {
+        for( std::size_t i; (i = next_definition++) < definitions.size(); )
+            build( *definitions[i] );
+    };
+    std::vector<std::thread> workers;
+    for( unsigned i = 1; i < threads && i < definitions.size(); ++i )
+        workers.emplace_back( work );
+    work();
+    for( auto & worker : workers )
+        worker.join();
 }
 
 std::unique_ptr<Statement> SemanticAnalyser::next() {
@@ -23,44 +100,113 @@ const Statement * SemanticAnalyser::peek() {
 }
 
 bool SemanticAnalyser::has_next() const {
-    return !parser_stack.empty() && parser_stack.top()->has_next();
+    if( two_pass )
+        return position < entries.size();
+    return !parser_stack.empty();
 }
 
-void SemanticAnalyser::compute_next() {
-    try {
-        auto ptr = parser_stack.top()->next();
+std::set<SemanticAnalyser::FileId> & SemanticAnalyser::included() {
+    static std::set<FileId> files;
+    return files;
+}
 
-        if( !parser_stack.top()->has_next() )
-            parser_stack.pop();
+/* Pops the files already read. */
+void SemanticAnalyser::pop_finished() {
+    while( !parser_stack.empty() && !parser_stack.top()->has_next() )
+        parser_stack.pop();
+}
 
-        if( typeid(*ptr) != typeid(OperatorDefinition) ) {
-            if( auto include = dynamic_cast<IncludeCommand *>(ptr.get()) ) {
-                parser_stack.emplace(
-                        std::make_unique<Parser>(include->filename.lexeme.c_str())
-                    );
-            }
-            if( auto category = dynamic_cast<CategoryDefinition *>(ptr.get()) )
-                SymbolTable::insertCategory(category->name.lexeme );
-            _next = std::move( ptr );
-            return;
-        }
-        OperatorDefinition & def = static_cast<OperatorDefinition&>(*ptr);
-        if( def.format == "f" )
-            _next = std::move( buildNullaryTree(def) );
-        else if( def.format == "fx"
-              || def.format == "fy"
-              || def.format == "xf"
-              || def.format == "yf" )
-            _next = std::move( buildUnaryTree(def) );
-        else
-            _next = std::move( buildBinaryTree(def) );
+/* Pushes the file, unless it was already included. */
+void SemanticAnalyser::include( const char * filename ) {
+    struct stat status;
+    if( stat( filename, &status ) == 0
+            && !included().insert( FileId( status.st_dev, status.st_ino ) ).second )
+        return;
+    /* If the file cannot be read, the lexer raises the error. */
+    parser_stack.emplace( std::make_unique<Parser>(filename) );
+    pop_finished();
+}
 
-        OperatorOverload & op = static_cast<OperatorOverload&>(*_next);
-        SymbolTable::insertOverload( op.name, def.format, def.priority,
-                std::move(std::unique_ptr<OperatorOverload>(op.clone())) );
+/* Reads the next statement, following includes and inserting categories. */
+std::unique_ptr<Statement> SemanticAnalyser::read( unsigned statement ) {
+    std::unique_ptr<Statement> ptr;
+    try {
+        ptr = parser_stack.top()->next();
     }
     catch ( parse_error & err ) {
         parser_stack.top()->panic();
+        pop_finished();
+        throw;
+    }
+    pop_finished();
+
+    if( ptr->kind == Statement::include )
+        include( static_cast<IncludeCommand&>(*ptr).filename.lexeme.c_str() );
+    if( ptr->kind == Statement::category )
+        SymbolTable::insertCategory(
+                static_cast<CategoryDefinition&>(*ptr).name.lexeme, statement );
+    return ptr;
+}
+
+void SemanticAnalyser::compute_next() {
+    if( two_pass ) {
+        compute_next_entry();
+        return;
+    }
+
+    auto ptr = read( 0 );
+    if( ptr->kind != Statement::definition ) {
+        _next = std::move( ptr );
+        return;
+    }
+    OperatorDefinition & def = static_cast<OperatorDefinition&>(*ptr);
+    _next = build_overload( def );
+
+    OperatorOverload & op = static_cast<OperatorOverload&>(*_next);
+    SymbolTable::insertOverload( op.name, def.format, def.priority,
+            std::move(std::unique_ptr<OperatorOverload>(op.clone())) );
+}
+
+/* Builds the body of the entry, seeing only the statements before it.
+ * Called by the second pass, maybe in parallel. */
+void SemanticAnalyser::build( Entry & entry ) {
+    SymbolTable::hideFrom( entry.index );
+    entry.error = nullptr;
+    try {
+        entry.overload = build_overload( static_cast<OperatorDefinition&>(*entry.statement) );
+    } catch( ... ) {
+        entry.error = std::current_exception();
+    }
+    SymbolTable::hideFrom( -1 );
+}
+
+void SemanticAnalyser::compute_next_entry() {
+    Entry & entry = entries[position++];
+    if( !entry.statement )
+        std::rethrow_exception( entry.error );
+    if( entry.statement->kind != Statement::definition ) {
+        _next = std::move( entry.statement );
+        return;
+    }
+
+    if( !speculative )
+        build( entry );
+    try {
+        if( entry.error )
+            std::rethrow_exception( entry.error );
+        auto & def = static_cast<OperatorDefinition&>(*entry.statement);
+        _next = std::move( entry.overload );
+        OperatorOverload & op = static_cast<OperatorOverload&>(*_next);
+        SymbolTable::hideFrom( entry.index );
+        SymbolTable::insertOverload( op.name, def.format, def.priority,
+                std::unique_ptr<OperatorOverload>(op.clone()), entry.index );
+        SymbolTable::hideFrom( -1 );
+    } catch( ... ) {
+        SymbolTable::hideFrom( -1 );
+        if( speculative && entry.declares ) {
+            SymbolTable::eraseOperators( entry.index );
+            speculative = false;
+        }
         throw;
     }
 }
@@ -80,12 +226,11 @@ std::pair< std::unique_ptr<SemanticAnalyser>, std::unique_ptr<OperatorBody> >
     Parser parser( "f 0 dummy " + line );
     auto ptr = parser.next();
 
-    auto * op = dynamic_cast<OperatorDefinition *>( ptr.get() );
-    if( !op )
+    if( !ptr || ptr->kind != Statement::definition )
         throw semantic_error( "No valid parsing found" );
 
     return std::make_pair(
                 std::unique_ptr<SemanticAnalyser>(nullptr),
-                std::move(buildNullaryTree(*op)->body)
+                std::move(buildNullaryTree(static_cast<OperatorDefinition&>(*ptr))->body)
         );
 }
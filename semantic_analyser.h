@@ -8,18 +8,49 @@
  *
  * There should be at most one SemanticAnalyser per program,
  * as these objects modify the SymbolTable.
+ *
+ * Each body is built against the symbols of the statements before it,
+ * so the statements are normally analysed one at a time. Given several
+ * threads, the analyser works in two passes instead. The first pass reads
+ * every statement, following the includes, inserts the categories, and
+ * declares each operator at its first definition, as if every body were
+ * valid (see SymbolTable::declareOperator). The second pass builds all the
+ * bodies in parallel; each one sees only the symbols defined before it
+ * (see SymbolTable::hideFrom), so the trees are the ones built by the
+ * sequential analysis. Then next() returns the statements and raises
+ * the errors in program order, inserting the overloads as it goes.
+ *
+ * The guess is wrong only if the body that declared an operator is invalid;
+ * the operator would then be created by some later definition. In this case,
+ * the operators declared from that statement on are removed, and next()
+ * builds the remaining bodies one at a time, as the sequential analysis.
+ *
+ * Each file is read at most once per process, as every analyser inserts
+ * into the same SymbolTable; later includes of the same file, by whatever
+ * path, are returned but not followed. This holds for the program itself
+ * and for the includes of the interactive mode. Files are told apart by
+ * their device and inode numbers. The set of read files is not
+ * synchronized: analysers must not run concurrently.
  */
 #ifndef SEMANTIC_ANALYSER_H
 #define SEMANTIC_ANALYSER_H
 
+#include <exception>
+#include <set>
 #include <utility>
 #include <stack>
+#include <vector>
+#include "operator.h"
 #include "parser.h"
 
 struct SemanticAnalyser {
     SemanticAnalyser() = default;
     SemanticAnalyser( std::unique_ptr<Parser>&& parser );
 
+    /* If threads > 1, analyses the program in two passes,
+     * building the bodies on the given number of threads. */
+    SemanticAnalyser( std::unique_ptr<Parser>&& parser, unsigned threads );
+
     std::unique_ptr<Statement> next();
 
     /* The returned pointer should not be deleted. */
@@ -31,9 +62,34 @@ struct SemanticAnalyser {
     bool has_next() const;
 
 private:
+    /* Device and inode numbers of a file. */
+    using FileId = std::pair<unsigned long long, unsigned long long>;
+
+    /* The files already read by some analyser of the process. */
+    static std::set<FileId> & included();
+
     std::stack<std::unique_ptr<Parser>> parser_stack;
     std::unique_ptr<Statement> _next;
     void compute_next();
+    std::unique_ptr<Statement> read( unsigned statement );
+    void include( const char * filename );
+    void pop_finished();
+
+    /* A statement read by the first pass of the two-pass analysis;
+     * statements are numbered from 1. */
+    struct Entry {
+        unsigned index;
+        std::unique_ptr<Statement> statement;
+        std::unique_ptr<OperatorOverload> overload; // The built definition.
+        std::exception_ptr error;
+        bool declares = false; // Whether the definition declared its operator.
+    };
+    std::vector<Entry> entries;
+    std::size_t position = 0; // Of the next entry to be returned.
+    bool two_pass = false;
+    bool speculative = false; // Whether the declarations are still right.
+    void build( Entry & );
+    void compute_next_entry();
 };
 
 /* If the line contains a valid language construct, returns a
@@ -5,6 +5,6 @@
 
 static unsigned last_category_value = 0;
 
-std::unique_ptr<Category> Category::next( std::string name ) {
+std::unique_ptr<Category> Category::next( Name name ) {
     return std::make_unique<Category>( name, last_category_value++ );
 }
@@ -9,15 +9,20 @@
 
 #include <memory>
 #include <string>
+#include "name.h"
 
 struct Symbol {
-    Symbol( std::string name ) : name( name ) {}
+    Symbol( Name name ) : name( name ) {}
     virtual ~Symbol() = default;
-    std::string name;
+    Name name;
+
+    /* Index of the statement that defined the symbol,
+     * if the program is analysed in two passes (see semantic_analyser.h). */
+    unsigned defined_at = 0;
 };
 
 struct Category : public Symbol {
-    Category( std::string name, unsigned value ) :
+    Category( Name name, unsigned value ) :
         Symbol( name ),
         value( value )
     {}
@@ -26,7 +31,7 @@ struct Category : public Symbol {
     /* Constructs a new category pointer.
      * Internal management is done to guarantee uniqueness
      * among the value of the category. */
-    static std::unique_ptr<Category> next( std::string name );
+    static std::unique_ptr<Category> next( Name name );
 };
 
 #endif // SYMBOL_H
@@ -1,6 +1,7 @@
 /* symbol_table.cpp
  * Implementation of symbol_table.h
  */
+#include <algorithm>
 #include <unordered_map>
 #include "exceptions.h"
 #include "symbol_table.h"
@@ -9,167 +10,214 @@ namespace SymbolTable {
 
 /* Separate symbol tables for each type of symbol. */
 namespace tables {
-    std::unordered_map<std::string, std::unique_ptr<Category>> category;
-    std::unordered_map<std::string, std::unique_ptr<NullaryOperator>> nullary;
-    std::unordered_map<std::string, std::unique_ptr<UnaryOperator>> postfix;
-    std::unordered_map<std::string, std::unique_ptr<UnaryOperator>> prefix;
-    std::unordered_map<std::string, std::unique_ptr<BinaryOperator>> binary;
+    std::unordered_map<Name, std::unique_ptr<Category>> category;
+    std::unordered_map<Name, std::unique_ptr<NullaryOperator>> nullary;
+    std::unordered_map<Name, std::unique_ptr<UnaryOperator>> postfix;
+    std::unordered_map<Name, std::unique_ptr<UnaryOperator>> prefix;
+    std::unordered_map<Name, std::unique_ptr<BinaryOperator>> binary;
 
     NullaryOperator * lastInserted = nullptr;
+
+    /* Symbols defined at this statement or later are hidden. */
+    thread_local unsigned horizon = -1;
 } // namespace tables
 
-void insertCategory( std::string name ) {
-    tables::category.emplace( name, Category::next(name) );
+namespace {
+    bool visible( const Symbol & symbol ) {
+        return symbol.defined_at < tables::horizon;
+    }
+
+    /* Returns the symbol in the table, or nullptr if there is
+     * no such symbol or if it is hidden. */
+    template< typename Table >
+    auto retrieve( const Table & table, Name name ) -> decltype(table.begin()->second.get()) {
+        auto iter = table.find( name );
+        if( iter == table.end() || !visible(*iter->second) )
+            return nullptr;
+        return iter->second.get();
+    }
+
+    bool is_unary( const std::string & format ) {
+        return format == "yf" || format == "xf" || format == "fy" || format == "fx";
+    }
+    bool is_binary( const std::string & format ) {
+        return format == "xfx" || format == "xfy" || format == "yfx";
+    }
+
+    unsigned operand_priority( const std::string & format, unsigned priority ) {
+        return format == "fx" || format == "xf" ? priority - 1 : priority;
+    }
+    unsigned left_priority( const std::string & format, unsigned priority ) {
+        return format != "yfx" ? priority - 1 : priority;
+    }
+    unsigned right_priority( const std::string & format, unsigned priority ) {
+        return format != "xfy" ? priority - 1 : priority;
+    }
+} // anonymous namespace
+
+void hideFrom( unsigned statement ) {
+    tables::horizon = statement;
 }
 
-bool existsCategory( std::string name ) {
-    return tables::category.count(name) != 0;
+void insertCategory( Name name, unsigned statement ) {
+    auto pair = tables::category.emplace( name, Category::next(name) );
+    if( pair.second )
+        pair.first->second->defined_at = statement;
 }
 
-unsigned categoryValue( std::string name ) {
-    return tables::category[name]->value;
+bool existsCategory( Name name ) {
+    return retrieve( tables::category, name ) != nullptr;
 }
 
-void insertOverload( std::string name, std::string format,
-        unsigned priority, std::unique_ptr<OperatorOverload>&& overload )
+unsigned categoryValue( Name name ) {
+    return tables::category.find(name)->second->value;
+}
+
+bool declareOperator( Name name, std::string format,
+        unsigned priority, unsigned statement )
 {
     if( format == "f" ) {
-        if( tables::category.count(name) != 0 )
-            throw semantic_error( "There is already a category named " + name );
+        if( existsCategory(name) || tables::nullary.count(name) != 0 )
+            return false;
+        auto op = std::make_unique<NullaryOperator>( name );
+        op->priority = priority;
+        op->defined_at = statement;
+        tables::nullary.emplace( name, std::move(op) );
+        return true;
+    }
+    if( is_unary(format) ) {
+        auto ptr = format[0] == 'f' ? &tables::prefix : &tables::postfix;
+        if( ptr->count(name) != 0 )
+            return false;
+        auto op = std::make_unique<UnaryOperator>( name );
+        op->priority = priority;
+        op->operand_priority = operand_priority( format, priority );
+        op->defined_at = statement;
+        ptr->emplace( name, std::move(op) );
+        return true;
+    }
+    if( is_binary(format) ) {
+        if( tables::binary.count(name) != 0 )
+            return false;
+        auto op = std::make_unique<BinaryOperator>( name );
+        op->priority = priority;
+        op->left_priority = left_priority( format, priority );
+        op->right_priority = right_priority( format, priority );
+        op->defined_at = statement;
+        tables::binary.emplace( name, std::move(op) );
+        return true;
+    }
+    throw std::logic_error( "Unknown type" );
+}
 
-        bool operator_exists = tables::nullary.count(name) != 0;
-        if( !operator_exists )
-            tables::nullary.emplace(name, std::make_unique<NullaryOperator>(name));
+void insertOverload( Name name, std::string format, unsigned priority,
+        std::unique_ptr<OperatorOverload>&& overload, unsigned statement )
+{
+    if( format == "f" && existsCategory(name) )
+        throw semantic_error( "There is already a category named " + name.str() );
 
+    bool operator_exists = !declareOperator( name, format, priority, statement );
+
+    if( format == "f" ) {
         NullaryOperator & op = *tables::nullary[name];
         op.insert( std::move(overload) );
         tables::lastInserted = &op;
 
-        if( !operator_exists )
-            op.priority = priority;
-        else if( op.priority != priority )
-            throw semantic_error( "Conflicting operator priorities for " + name );
+        if( operator_exists && op.priority != priority )
+            throw semantic_error( "Conflicting operator priorities for " + name.str() );
     }
-    else if( format == "yf" || format == "xf" || format == "fy" || format == "fx" ) {
-        auto ptr = &tables::postfix;
-        unsigned operator_priority = priority;
-        unsigned operand_priority = priority;
-        if( format == "fx" || format == "xf" )
-            operand_priority--;
-        if( format == "fx" || format == "fy" )
-            ptr = &tables::prefix;
-
-        bool operator_exists = ptr->count(name) != 0;
-        if( !operator_exists )
-            ptr->emplace(name, std::make_unique<UnaryOperator>(name) );
-
+    else if( is_unary(format) ) {
+        auto ptr = format[0] == 'f' ? &tables::prefix : &tables::postfix;
         UnaryOperator & op = *(*ptr)[name];
         op.insert( std::move(overload) );
 
-        if( !operator_exists ) {
-            op.priority = operator_priority;
-            op.operand_priority = operand_priority;
-        }
-        else if( operator_priority != op.priority )
-            throw semantic_error( "Conflicting operator priorities for " + name );
-        else if( operand_priority != op.operand_priority )
-            throw semantic_error( "Conflicting types for operator " + name );
-    }
-    else if( format == "xfx" || format == "xfy" || format == "yfx" ) {
-        unsigned left_priority = priority;
-        unsigned right_priority = priority;
-        if( format != "yfx" )
-            left_priority--;
-        if( format != "xfy" )
-            right_priority--;
-
-        bool operator_exists = tables::binary.count(name) != 0;
         if( !operator_exists )
-            tables::binary.emplace(name, std::make_unique<BinaryOperator>(name));
-
+            return;
+        if( op.priority != priority )
+            throw semantic_error( "Conflicting operator priorities for " + name.str() );
+        if( op.operand_priority != operand_priority(format, priority) )
+            throw semantic_error( "Conflicting types for operator " + name.str() );
+    }
+    else {
         BinaryOperator & op = *tables::binary[name];
         op.insert( std::move(overload) );
-        if( !operator_exists ) {
-            op.priority = priority;
-            op.left_priority = left_priority;
-            op.right_priority = right_priority;
-        }
-        else if( op.priority != priority || op.left_priority != left_priority
-                || op.right_priority != right_priority )
-            throw semantic_error( "Conflicting operator priorities for " + name );
+        if( operator_exists && ( op.priority != priority
+                || op.left_priority != left_priority(format, priority)
+                || op.right_priority != right_priority(format, priority) ) )
+            throw semantic_error( "Conflicting operator priorities for " + name.str() );
     }
-    else
-        throw std::logic_error( "Unknown type" );
 }
 
-bool existsBinaryOperator( std::string name ) {
+void eraseOperators( unsigned statement ) {
+    auto erase = [statement]( auto & table ) {
+        for( auto iter = table.begin(); iter != table.end(); )
+            if( iter->second->defined_at >= statement )
+                iter = table.erase( iter );
+            else
+                ++iter;
+    };
+    erase( tables::nullary );
+    erase( tables::prefix );
+    erase( tables::postfix );
+    erase( tables::binary );
+}
+
+bool existsBinaryOperator( Name name ) {
     return retrieveBinaryOperator( name ) != nullptr;
 }
-bool existsPrefixOperator( std::string name ) {
+bool existsPrefixOperator( Name name ) {
     return retrievePrefixOperator( name ) != nullptr;
 }
-bool existsPostfixOperator( std::string name ) {
+bool existsPostfixOperator( Name name ) {
     return retrievePostfixOperator( name ) != nullptr;
 }
-bool existsNullaryOperator( std::string name ) {
+bool existsNullaryOperator( Name name ) {
     return retrieveNullaryOperator( name ) != nullptr;
 }
-bool existsOperator( std::string name ) {
+bool existsOperator( Name name ) {
     return existsNullaryOperator(name) ||
            existsPostfixOperator(name) ||
            existsPrefixOperator(name) ||
            existsBinaryOperator(name);
 }
 
-unsigned maximumPrefixPriority( std::string operator_name ) {
+unsigned maximumPrefixPriority( Name operator_name ) {
     return tables::prefix[operator_name]->operand_priority;
 }
-unsigned maximumPostfixPriority( std::string operator_name ) {
+unsigned maximumPostfixPriority( Name operator_name ) {
     return tables::postfix[operator_name]->operand_priority;
 }
-unsigned maximumLeftPriority( std::string operator_name ) {
+unsigned maximumLeftPriority( Name operator_name ) {
     return tables::binary[operator_name]->left_priority;
 }
-unsigned maximumRightPriority( std::string operator_name ) {
+unsigned maximumRightPriority( Name operator_name ) {
     return tables::binary[operator_name]->right_priority;
 }
 
-unsigned nullaryOperatorPriority( std::string name ) {
+unsigned nullaryOperatorPriority( Name name ) {
     return tables::nullary[name]->priority;
 }
-unsigned prefixOperatorPriority( std::string name ) {
+unsigned prefixOperatorPriority( Name name ) {
     return tables::prefix[name]->priority;
 }
-unsigned postfixOperatorPriority( std::string name ) {
+unsigned postfixOperatorPriority( Name name ) {
     return tables::postfix[name]->priority;
 }
-unsigned binaryOperatorPriority( std::string name ) {
+unsigned binaryOperatorPriority( Name name ) {
     return tables::binary[name]->priority;
 }
 
-const NullaryOperator * retrieveNullaryOperator( std::string name ) {
-    auto iter = tables::nullary.find( name );
-    if( iter == tables::nullary.end() )
-        return nullptr;
-    return iter->second.get();
+const NullaryOperator * retrieveNullaryOperator( Name name ) {
+    return retrieve( tables::nullary, name );
 }
-const UnaryOperator * retrievePrefixOperator( std::string name ) {
-    auto iter = tables::prefix.find( name );
-    if( iter == tables::prefix.end() )
-        return nullptr;
-    return iter->second.get();
+const UnaryOperator * retrievePrefixOperator( Name name ) {
+    return retrieve( tables::prefix, name );
 }
-const UnaryOperator * retrievePostfixOperator( std::string name ) {
-    auto iter = tables::postfix.find( name );
-    if( iter == tables::postfix.end() )
-        return nullptr;
-    return iter->second.get();
+const UnaryOperator * retrievePostfixOperator( Name name ) {
+    return retrieve( tables::postfix, name );
 }
-const BinaryOperator * retrieveBinaryOperator( std::string name ) {
-    auto iter = tables::binary.find( name );
-    if( iter == tables::binary.end() )
-        return nullptr;
-    return iter->second.get();
+const BinaryOperator * retrieveBinaryOperator( Name name ) {
+    return retrieve( tables::binary, name );
 }
 
 const NullaryOperator * lastNullaryInserted() {
@@ -179,15 +227,22 @@ const NullaryOperator * lastNullaryInserted() {
 } // namespace SymbolTable
 
 // Implementation of VariableList methods.
-void VariableList::insert( std::string name ) {
-    table.insert( name );
+unsigned VariableList::insert( Name name ) {
+    for( unsigned i = 0; i < names.size(); ++i )
+        if( names[i] == name )
+            return i;
+    names.push_back( name );
+    return names.size() - 1;
+}
+
+bool VariableList::contains( Name name ) const {
+    return std::find( names.begin(), names.end(), name ) != names.end();
 }
 
-bool VariableList::contains( std::string name ) const {
-    return table.count( name ) != 0;
+unsigned VariableList::slot( Name name ) const {
+    return std::find( names.begin(), names.end(), name ) - names.begin();
 }
 
-VariableList & VariableList::merge( const VariableList & other ) {
-    table.insert( other.table.begin(), other.table.end() );
-    return *this;
+unsigned VariableList::size() const {
+    return names.size();
 }
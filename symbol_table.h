@@ -5,8 +5,9 @@
 #ifndef SYMBOL_TABLE_H
 #define SYMBOL_TABLE_H
 
-#include <set>
 #include <string>
+#include <vector>
+#include "name.h"
 #include "symbol.h"
 #include "operator.h"
 
@@ -15,43 +16,59 @@
  * namely, categories and operators.
  */
 namespace SymbolTable {
-    void insertCategory( std::string name );
-    bool existsCategory( std::string name );
-    unsigned categoryValue( std::string name ); // assumes existsCategory
+    /* Hides, from the calling thread, the symbols defined by the given
+     * statement or by later ones; -1 shows every symbol again.
+     * Used by the two-pass analysis (see semantic_analyser.h), where the
+     * signatures of the whole program are known before the bodies are
+     * built, but each body must only see the statements before it. */
+    void hideFrom( unsigned statement );
+
+    void insertCategory( Name name, unsigned statement = 0 );
+    bool existsCategory( Name name );
+    unsigned categoryValue( Name name ); // assumes existsCategory
 
     /* Throws an exception if either
      *  - type is F and there is a category with same name, or
      *  - such an operator already exists with different priority. */
-    void insertOverload( std::string name, std::string format, unsigned priority,
-            std::unique_ptr<OperatorOverload>&& overload );
+    void insertOverload( Name name, std::string format, unsigned priority,
+            std::unique_ptr<OperatorOverload>&& overload, unsigned statement = 0 );
+
+    /* Creates the operator, with no overloads, as insertOverload would;
+     * does nothing if the operator already exists, or if type is F and
+     * there is a category with same name. Returns true if it was created. */
+    bool declareOperator( Name name, std::string format, unsigned priority,
+            unsigned statement );
 
-    bool existsBinaryOperator( std::string name );
-    bool existsPrefixOperator( std::string name );
-    bool existsPostfixOperator( std::string name );
-    bool existsNullaryOperator( std::string name );
-    bool existsOperator( std::string name );
+    /* Removes the operators defined by the given statement or later ones. */
+    void eraseOperators( unsigned statement );
+
+    bool existsBinaryOperator( Name name );
+    bool existsPrefixOperator( Name name );
+    bool existsPostfixOperator( Name name );
+    bool existsNullaryOperator( Name name );
+    bool existsOperator( Name name );
 
     /* Returns the minimum priority a prefix/postfix/left/right
      * operand can have. This function takes account for the grouping
      * of operators, defined by it's types. */
-    unsigned maximumPrefixPriority( std::string operator_name );
-    unsigned maximumPostfixPriority( std::string operator_name );
-    unsigned maximumLeftPriority( std::string operator_name );
-    unsigned maximumRightPriority( std::string operator_name );
+    unsigned maximumPrefixPriority( Name operator_name );
+    unsigned maximumPostfixPriority( Name operator_name );
+    unsigned maximumLeftPriority( Name operator_name );
+    unsigned maximumRightPriority( Name operator_name );
 
     /* Retrieves the priority of the operator.
      * assumes existsOperator*. */
-    unsigned nullaryOperatorPriority( std::string operator_name );
-    unsigned prefixOperatorPriority( std::string operator_name );
-    unsigned postfixOperatorPriority( std::string operator_name );
-    unsigned binaryOperatorPriority( std::string operator_name );
+    unsigned nullaryOperatorPriority( Name operator_name );
+    unsigned prefixOperatorPriority( Name operator_name );
+    unsigned postfixOperatorPriority( Name operator_name );
+    unsigned binaryOperatorPriority( Name operator_name );
 
     /* Returns pointers to the requested operators,
      * or nullptr if no such operator exists in this file. */
-    const NullaryOperator * retrieveNullaryOperator( std::string name );
-    const UnaryOperator * retrievePrefixOperator( std::string name );
-    const UnaryOperator * retrievePostfixOperator( std::string name );
-    const BinaryOperator * retrieveBinaryOperator( std::string name );
+    const NullaryOperator * retrieveNullaryOperator( Name name );
+    const UnaryOperator * retrievePrefixOperator( Name name );
+    const UnaryOperator * retrievePostfixOperator( Name name );
+    const BinaryOperator * retrieveBinaryOperator( Name name );
 
     /* Returns the last nullary operator inserted, or nullptr if
      * none was inserted.
@@ -63,16 +80,22 @@ namespace SymbolTable {
     const NullaryOperator * lastNullaryInserted();
 }
 
-/* Local symbol table used to store the operator parameters. */
+/* Local symbol table used to store the operator parameters.
+ * Each distinct name is assigned a slot, in insertion order;
+ * the slots index the Frame of the overload at runtime.
+ * Signatures have few variables, so the names are searched linearly. */
 class VariableList {
-    std::set< std::string > table;
+    std::vector< Name > names; // names[slot]
 
 public:
-    void insert( std::string symbol );
-    bool contains( std::string symbol ) const;
+    /* Returns the slot of the symbol, assigning a new one if needed. */
+    unsigned insert( Name symbol );
+    bool contains( Name symbol ) const;
+
+    /* Assumes contains(symbol). */
+    unsigned slot( Name symbol ) const;
 
-    /* Joins two local symbol tables.
-     * Returns *this. */
-    VariableList& merge( const VariableList & );
+    /* Number of slots assigned so far. */
+    unsigned size() const;
 };
 #endif // SYMBOL_TABLE_H
@@ -0,0 +1,256 @@
+/* task_scheduler.cpp
+ * Implementation of task_scheduler.h
+ */
+#include <deque>
+#include <exception>
+#include <unordered_set>
+#include "call_cache.h"
+#include "operator.h"
+#include "task_scheduler.h"
+
+/* The second operand of a forked node. The task lives in the stack
+ * of the thread that forked it, which waits for it before returning. */
+struct TaskScheduler::Task {
+    const OperatorBody & body;
+    const Frame & frame;
+    VariableFork & fork;
+    Variable result;
+    std::exception_ptr error;
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> done{false};
+};
+
+/* The owner pushes and pops tasks at the back; thieves take them from
+ * the front. 'size' mirrors tasks.size(), so that the owner can read it
+ * without the lock. */
+struct TaskScheduler::Worker {
+    std::mutex mutex;
+    std::deque<Task *> tasks;
+    std::atomic<unsigned> size{0};
+    unsigned index;
+};
+
+TaskScheduler * TaskScheduler::active = nullptr;
+thread_local TaskScheduler::Worker * TaskScheduler::self = nullptr;
+thread_local const std::atomic<bool> * TaskScheduler::cancelled = nullptr;
+
+TaskScheduler::TaskScheduler( unsigned thread_count, unsigned grain ) :
+    grain( grain )
+{
+    for( unsigned i = 0; i < thread_count; ++i ) {
+        workers.emplace_back( new Worker );
+        workers.back()->index = i;
+    }
+    self = workers[0].get();
+    for( unsigned i = 1; i < thread_count; ++i )
+        threads.emplace_back( &TaskScheduler::loop, this, std::ref(*workers[i]) );
+    active = this;
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for( auto & thread : threads )
+        thread.join();
+    self = nullptr;
+    if( active == this )
+        active = nullptr;
+}
+
+void TaskScheduler::loop( Worker & worker ) {
+    self = &worker;
+    while( true ) {
+        if( Task * task = steal( worker ) ) {
+            run( *task );
+            continue;
+        }
+        std::unique_lock<std::mutex> lock( mutex );
+        wakeup.wait( lock, [this]{ return stopping || queued > 0; } );
+        if( stopping )
+            return;
+    }
+}
+
+void TaskScheduler::push( Worker & worker, Task & task ) {
+    {
+        /* 'queued' is counted before the task becomes visible,
+         * so that no thief can take it, and decrement, first. */
+        std::lock_guard<std::mutex> lock( worker.mutex );
+        ++queued;
+        worker.tasks.push_back( &task );
+        ++worker.size;
+    }
+    /* A thread that found no task holds the lock until it sleeps,
+     * so taking the lock here ensures that it is notified. */
+    { std::lock_guard<std::mutex> lock( mutex ); }
+    wakeup.notify_one();
+}
+
+TaskScheduler::Task * TaskScheduler::steal( Worker & thief ) {
+    for( unsigned i = 1; i < workers.size(); ++i ) {
+        Worker & victim = *workers[(thief.index + i) % workers.size()];
+        if( victim.size.load( std::memory_order_relaxed ) == 0 )
+            continue;
+        std::lock_guard<std::mutex> lock( victim.mutex );
+        if( victim.tasks.empty() )
+            continue;
+        Task * task = victim.tasks.front();
+        victim.tasks.pop_front();
+        --victim.size;
+        --queued;
+        return task;
+    }
+    return nullptr;
+}
+
+void TaskScheduler::run( Task & task ) {
+    const std::atomic<bool> * previous = cancelled;
+    cancelled = &task.cancelled;
+    try {
+        VariableFork::Branch branch( task.fork );
+        task.result = task.body.evaluate( task.frame );
+    } catch( ... ) {
+        task.error = std::current_exception();
+    }
+    cancelled = previous;
+    task.done.store( true, std::memory_order_release );
+}
+
+/* Runs the task if it is still in the deque; otherwise, waits for the
+ * thief, running other tasks meanwhile. A cancelled task that was not
+ * stolen is simply dropped. */
+void TaskScheduler::finish( Worker & worker, Task & task ) {
+    bool popped = false;
+    {
+        std::lock_guard<std::mutex> lock( worker.mutex );
+        if( !worker.tasks.empty() && worker.tasks.back() == &task ) {
+            worker.tasks.pop_back();
+            --worker.size;
+            --queued;
+            popped = true;
+        }
+    }
+    if( popped ) {
+        if( !task.cancelled )
+            run( task );
+        return;
+    }
+    while( !task.done.load( std::memory_order_acquire ) )
+        if( Task * other = steal( worker ) )
+            run( *other );
+        else
+            std::this_thread::yield();
+}
+
+std::pair<Variable, Variable> TaskScheduler::evaluate(
+        const OperatorBody & first, const OperatorBody & second, const Frame & frame )
+{
+    Worker & worker = *self;
+    if( worker.size.load( std::memory_order_relaxed ) >= grain || CallCache::active ) {
+        Variable lvar = first.evaluate( frame );
+        Variable rvar = second.evaluate( frame );
+        return { std::move(lvar), std::move(rvar) };
+    }
+
+    /* The values of both operands die before the fork releases their stores. */
+    VariableFork fork;
+    Task task{ second, frame, fork, Variable(), nullptr };
+    push( worker, task );
+    Variable lvar;
+    try {
+        lvar = first.evaluate( frame );
+    } catch( ... ) {
+        task.cancelled = true;
+        finish( worker, task );
+        throw;
+    }
+    finish( worker, task );
+    if( task.error )
+        std::rethrow_exception( task.error );
+    return fork.join( lvar, task.result );
+}
+
+namespace {
+
+/* Returns true if the operator has some overload that is not native. */
+template< typename Operator >
+bool is_user_defined( const Operator & op ) {
+    for( const auto & overload : op.overloads )
+        if( overload->body->kind != OperatorBody::native )
+            return true;
+    return false;
+}
+
+struct Marker {
+    std::unordered_set<const Symbol *> visited;
+    std::vector<std::pair<const Symbol *, unsigned>> pending; // Operators and arities.
+
+    void visit( const Symbol * op, unsigned arity ) {
+        if( visited.insert( op ).second )
+            pending.emplace_back( op, arity );
+    }
+
+    /* Marks the nodes of the body; returns true if the body
+     * calls some operator that is not native. */
+    bool mark( OperatorBody & body ) {
+        switch( body.kind ) {
+            case OperatorBody::pair: {
+                auto & pair = static_cast<PairBody &>( body );
+                bool first = mark( *pair.first );
+                bool second = mark( *pair.second );
+                pair.fork = first && second;
+                return first || second;
+            }
+            case OperatorBody::nullary: {
+                auto & tree = static_cast<NullaryTreeBody &>( body );
+                visit( tree.op, 0 );
+                return is_user_defined( *tree.op );
+            }
+            case OperatorBody::unary: {
+                auto & tree = static_cast<UnaryTreeBody &>( body );
+                visit( tree.op, 1 );
+                bool variable = mark( *tree.variable );
+                return variable || is_user_defined( *tree.op );
+            }
+            case OperatorBody::binary: {
+                auto & tree = static_cast<BinaryTreeBody &>( body );
+                visit( tree.op, 2 );
+                bool left = mark( *tree.left );
+                bool right = mark( *tree.right );
+                tree.fork = left && right;
+                return left || right || is_user_defined( *tree.op );
+            }
+            default:
+                return false;
+        }
+    }
+
+    template< typename Operator >
+    void mark_overloads( const Symbol * symbol ) {
+        for( const auto & overload : static_cast<const Operator *>( symbol )->overloads )
+            mark( *overload->body );
+    }
+
+    void mark_pending() {
+        while( !pending.empty() ) {
+            auto pair = pending.back();
+            pending.pop_back();
+            switch( pair.second ) {
+                case 0: mark_overloads<NullaryOperator>( pair.first ); break;
+                case 1: mark_overloads<UnaryOperator>( pair.first ); break;
+                case 2: mark_overloads<BinaryOperator>( pair.first ); break;
+            }
+        }
+    }
+};
+
+} // anonymous namespace
+
+void markForks( const NullaryOperator & entry ) {
+    Marker marker;
+    marker.visit( &entry, 0 );
+    marker.mark_pending();
+}
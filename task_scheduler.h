@@ -0,0 +1,97 @@
+/* task_scheduler.h
+ * Parallel evaluation of independent operands.
+ *
+ * Evaluation has no side effects, so the operands of a binary operator,
+ * like the two halves of a pair, may be computed at the same time.
+ * While a TaskScheduler is active, the tree walker evaluates the operands
+ * of the nodes marked by markForks in parallel: the second operand
+ * becomes a task, pushed to the deque of the current thread, and the
+ * first operand is evaluated in place. Idle threads steal the oldest
+ * task of some other deque, which is usually the largest one.
+ * If nobody stole the task when the first operand is done, the thread
+ * evaluates it itself; otherwise, it runs stolen tasks while it waits.
+ *
+ * Two thresholds keep tasks from being too small to pay for themselves.
+ * markForks only marks nodes whose operands both call operators other
+ * than natives; arithmetic alone is never worth a task. And a thread
+ * only forks while its deque has fewer than 'grain' tasks, so new tasks
+ * are created roughly as fast as the other threads steal them.
+ *
+ * Results and errors are those of the sequential evaluation. The node
+ * waits for both operands before returning. If the first operand fails,
+ * its error is raised, and the task is cancelled: it stops at its next
+ * operator call, so that it costs no more than it would have if it had
+ * not been started. Otherwise, the error of the task, if any, is raised.
+ * Each operand creates its values in its own store (see VariableFork in
+ * variable.h).
+ *
+ * The CallCache is not thread-safe; nothing is forked while it is active.
+ */
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "ast.h"
+#include "exceptions.h"
+#include "variable.h"
+
+class TaskScheduler {
+    struct Task;
+    struct Worker;
+
+    std::vector<std::unique_ptr<Worker>> workers; // workers[0] is the constructing thread.
+    std::vector<std::thread> threads;
+    unsigned grain;
+
+    // Idle threads sleep until some task is queued.
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::atomic<unsigned> queued{0};
+    bool stopping = false;
+
+    static thread_local Worker * self;
+    /* Cancellation flag of the task being run by the thread, if any. */
+    static thread_local const std::atomic<bool> * cancelled;
+
+    void loop( Worker & );
+    void push( Worker &, Task & );
+    Task * steal( Worker & thief );
+    void run( Task & );
+    void finish( Worker &, Task & );
+
+public:
+    /* The scheduler used by the tree walker, or nullptr if
+     * evaluation is sequential. */
+    static TaskScheduler * active;
+
+    /* Starts threads - 1 threads, that join the constructing thread in
+     * the evaluation, and makes the scheduler the active one. */
+    explicit TaskScheduler( unsigned threads, unsigned grain = 2 );
+    ~TaskScheduler();
+
+    TaskScheduler( const TaskScheduler& ) = delete;
+    TaskScheduler& operator=( const TaskScheduler& ) = delete;
+
+    /* Evaluates both bodies over the frame, possibly in parallel. */
+    std::pair<Variable, Variable> evaluate( const OperatorBody & first,
+            const OperatorBody & second, const Frame & );
+
+    /* Raises task_cancelled if the task run by the calling thread
+     * was cancelled. The sequential evaluation only tests 'active'. */
+    static void poll() {
+        if( active && cancelled && cancelled->load( std::memory_order_relaxed ) )
+            throw task_cancelled();
+    }
+};
+
+/* Marks the pairs and the binary operator calls, in every operator
+ * reachable from the entry point, whose operands are worth a task. */
+void markForks( const NullaryOperator & entry );
+
+#endif // TASK_SCHEDULER_H
@@ -0,0 +1,30 @@
+/* execute.h
+ * Runs commands in the shell, for the tests that run the
+ * interpreter ('a.out', built by 'make all'). These tests must be run
+ * from the root of the repository, like 'make test' does.
+ */
+#ifndef TEST_EXECUTE_H
+#define TEST_EXECUTE_H
+
+#include <cstdio>
+#include <string>
+#include <catch.hpp>
+
+struct Result {
+    int status;
+    std::string output;
+};
+
+/* Runs the command in the shell, capturing its standard output. */
+inline Result execute( const std::string & command ) {
+    Result result;
+    FILE * pipe = popen( ("exec 2>/dev/null; " + command).c_str(), "r" );
+    REQUIRE( pipe );
+    char buffer[256];
+    while( std::fgets(buffer, sizeof(buffer), pipe) )
+        result.output += buffer;
+    result.status = pclose( pipe );
+    return result;
+}
+
+#endif // TEST_EXECUTE_H
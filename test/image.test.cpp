@@ -0,0 +1,96 @@
+/* image.test.cpp
+ * Compiles images of the examples and of a small program, and runs
+ * them with --load: valid images must print what the program prints,
+ * while stale or damaged ones must be analysed again. Runs the
+ * interpreter, and writes its files in test/; see execute.h.
+ */
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <catch.hpp>
+#include "execute.h"
+
+namespace {
+    const char * image = "test/image.img";
+    const std::string stale = "Image test/image.img is stale or invalid; analysing the program.\n";
+
+    void write( const char * filename, const std::string & contents ) {
+        std::ofstream file( filename, std::ios::binary | std::ios::trunc );
+        file << contents;
+        REQUIRE( file );
+    }
+
+    std::string read( const char * filename ) {
+        std::ifstream file( filename, std::ios::binary );
+        return std::string( std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>() );
+    }
+
+    /* Runs the program from the image, with the messages. */
+    Result load( const std::string & program ) {
+        return execute( "./a.out --load " + std::string(image) + " " + program + " 2>&1" );
+    }
+} // anonymous namespace
+
+TEST_CASE( "Images", "[image]" ) {
+    REQUIRE( std::ifstream("a.out") );
+
+    SECTION( "loaded images print what the program prints" ) {
+        const char * examples[] = { "examples/peano", "examples/features" };
+        for( std::string example : examples ) {
+            INFO( example );
+            REQUIRE( execute( "./a.out --compile-to " + std::string(image) + " " + example ).status == 0 );
+            Result run = execute( "./a.out " + example + " 2>&1" );
+            Result loaded = load( example );
+            CHECK( loaded.status == 0 );
+            CHECK( loaded.output == run.output );
+        }
+    }
+
+    SECTION( "images of other programs are stale" ) {
+        REQUIRE( execute( "./a.out --compile-to " + std::string(image) + " examples/peano" ).status == 0 );
+        Result loaded = load( "examples/features" );
+        CHECK( loaded.output == stale + execute( "./a.out examples/features" ).output );
+    }
+
+    SECTION( "changing an included file makes the image stale" ) {
+        const char * program = "test/image_program";
+        const char * library = "test/image_library";
+        write( program, "include test/image_library\nf 0 main\n    value\n" );
+        write( library, "f 0 value\n    1\n" );
+        REQUIRE( execute( "./a.out --compile-to " + std::string(image) + " " + program ).status == 0 );
+        CHECK( load( program ).output == "1\n" );
+
+        write( library, "f 0 value\n    2\n" );
+        CHECK( load( program ).output == stale + "2\n" );
+
+        std::remove( program );
+        std::remove( library );
+    }
+
+    SECTION( "damaged images are rejected" ) {
+        REQUIRE( execute( "./a.out --compile-to " + std::string(image) + " examples/peano" ).status == 0 );
+        const std::string original = read( image );
+        const std::string expected = stale + execute( "./a.out examples/peano" ).output;
+        REQUIRE( original.size() > 256 );
+
+        /* The header, the records, and the table of characters at the end. */
+        for( std::size_t position : { std::size_t(0), std::size_t(20), std::size_t(200),
+                original.size() / 2, original.size() - 1 } ) {
+            INFO( "bit flipped at " << position );
+            std::string damaged = original;
+            damaged[position] ^= 0x10;
+            write( image, damaged );
+            CHECK( load( "examples/peano" ).output == expected );
+        }
+        for( std::size_t size : { std::size_t(0), std::size_t(64), original.size() / 2,
+                original.size() - 1 } ) {
+            INFO( "truncated to " << size << " bytes" );
+            write( image, original.substr( 0, size ) );
+            CHECK( load( "examples/peano" ).output == expected );
+        }
+    }
+
+    std::remove( image );
+}
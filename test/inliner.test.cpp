@@ -0,0 +1,27 @@
+/* inliner.test.cpp
+ * Checks that inlining keeps the order in which the arguments of a
+ * call are evaluated, on examples/ordering. Runs the interpreter;
+ * see execute.h.
+ */
+#include <fstream>
+#include <string>
+#include <catch.hpp>
+#include "execute.h"
+
+TEST_CASE( "Inlined arguments are evaluated before the body", "[inliner]" ) {
+    REQUIRE( std::ifstream("a.out") );
+
+    /* The program never ends; the sum that fails inside 'pick'
+     * must not be reached before the argument 'loop 0'. */
+    const char * options[] = {
+        "",
+        "--fold-budget 0 ",
+        "--inline-limit 0 ",
+    };
+    for( std::string option : options ) {
+        INFO( "./a.out " << option << "examples/ordering" );
+        Result run = execute( "timeout 2 ./a.out " + option + "examples/ordering" );
+        CHECK( run.status != 0 );
+        CHECK( run.output == "" );
+    }
+}
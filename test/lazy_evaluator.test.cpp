@@ -0,0 +1,33 @@
+/* lazy_evaluator.test.cpp
+ * Checks the results of --lazy that differ from the ones of the tree
+ * walker, on examples/choice and examples/shortcut, which exist for
+ * this test. Runs the interpreter; see execute.h.
+ */
+#include <fstream>
+#include <string>
+#include <catch.hpp>
+#include "execute.h"
+
+TEST_CASE( "Lazy evaluation skips the operands never forced", "[LazyEvaluator]" ) {
+    REQUIRE( std::ifstream("a.out") );
+
+    SECTION( "an operand that fails may select another overload" ) {
+        Result lazy = execute( "./a.out --lazy examples/choice" );
+        CHECK( lazy.status == 0 );
+        CHECK( lazy.output == "1\n" );
+
+        Result strict = execute( "./a.out -t examples/choice" );
+        CHECK( strict.status == 0 );
+        CHECK( strict.output == "7\n" );
+    }
+
+    SECTION( "short circuits, and thunks failing in other calls" ) {
+        Result lazy = execute( "./a.out --lazy examples/shortcut" );
+        CHECK( lazy.status == 0 );
+        CHECK( lazy.output == "{42, {0, {0, 5}}}\n" );
+
+        Result strict = execute( "./a.out -t examples/shortcut" );
+        CHECK( strict.status != 0 );
+        CHECK( strict.output == "" );
+    }
+}
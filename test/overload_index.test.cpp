@@ -0,0 +1,51 @@
+/* overload_index.test.cpp
+ * Unit test of the candidate lists produced by OverloadIndex.
+ */
+#include "overload_index.h"
+#include <catch.hpp>
+
+TEST_CASE( "OverloadIndex candidates", "[OverloadIndex]" ) {
+    typedef std::vector<unsigned> list;
+    PatternKey any{ PatternKey::any, 0 };
+    PatternKey number{ PatternKey::number, 0 };
+    PatternKey pair{ PatternKey::pair, 0 };
+    auto literal = []( long long v ) { return PatternKey{ PatternKey::literal, v }; };
+
+    Variable zero( 0LL ), one( 1LL ), two( 2LL ), tuple( zero, one );
+
+    SECTION( "unary operator" ) {
+        OverloadIndex index( 1 );
+        index.insert( { literal(1) }, 0 );
+        index.insert( { pair }, 1 );
+        index.insert( { number }, 2 );
+        index.insert( { literal(2) }, 3 );
+        index.insert( { any }, 4 );
+
+        CHECK( index.candidates( one ) == (list{ 0, 2, 4 }) );
+        CHECK( index.candidates( two ) == (list{ 2, 3, 4 }) );
+        CHECK( index.candidates( zero ) == (list{ 2, 4 }) );
+        CHECK( index.candidates( tuple ) == (list{ 1, 4 }) );
+    }
+
+    SECTION( "binary operator" ) {
+        OverloadIndex index( 2 );
+        index.insert( { literal(0), any }, 0 );
+        index.insert( { any, literal(1) }, 1 );
+        index.insert( { pair, number }, 2 );
+        index.insert( { any, any }, 3 );
+
+        CHECK( index.candidates( zero, one ) == (list{ 0, 1, 3 }) );
+        CHECK( index.candidates( zero, two ) == (list{ 0, 3 }) );
+        CHECK( index.candidates( two, one ) == (list{ 1, 3 }) );
+        CHECK( index.candidates( tuple, two ) == (list{ 2, 3 }) );
+        CHECK( index.candidates( tuple, tuple ) == (list{ 3 }) );
+    }
+
+    SECTION( "nullary operator" ) {
+        OverloadIndex index( 0 );
+        index.insert( {}, 0 );
+        index.insert( {}, 1 );
+
+        CHECK( index.candidates() == (list{ 0, 1 }) );
+    }
+}
@@ -0,0 +1,35 @@
+/* task_scheduler.test.cpp
+ * Compares the output of the parallel evaluator with the output of
+ * the sequential tree walker, on the examples; examples/parallel
+ * exists for this test. Runs the interpreter; see execute.h.
+ */
+#include <fstream>
+#include <string>
+#include <utility>
+#include <catch.hpp>
+#include "execute.h"
+
+TEST_CASE( "Parallel evaluation prints what the tree walker prints", "[TaskScheduler]" ) {
+    REQUIRE( std::ifstream("a.out") );
+
+    /* The examples, and whether they can be run. */
+    std::pair<std::string, bool> examples[] = {
+        { "examples/peano", true },
+        { "examples/features", true },
+        { "examples/failure", false },
+        { "examples/parallel", true },
+    };
+
+    /* The threads race differently on each run. */
+    for( int run = 0; run < 5; ++run )
+        for( const auto & example : examples ) {
+            INFO( "./a.out -j 4 " << example.first );
+            /* The messages of the failures are compared too. */
+            Result sequential = execute( "./a.out -t " + example.first + " 2>&1" );
+            Result parallel = execute( "timeout 10 ./a.out -j 4 " + example.first + " 2>&1" );
+
+            CHECK( (sequential.status == 0) == example.second );
+            CHECK( (parallel.status == 0) == example.second );
+            CHECK( parallel.output == sequential.output );
+        }
+}
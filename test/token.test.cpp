@@ -29,7 +29,7 @@ TEST_CASE( "Token relational operators", "[Token][relational]" ) {
        }
 
        SECTION( "difference on second attribute" ) {
-           a.lexeme[2]++;
+           a.lexeme = "TOL";
 
            CHECK_FALSE( a == b );
            CHECK_FALSE( a <= b );
@@ -41,7 +41,7 @@ TEST_CASE( "Token relational operators", "[Token][relational]" ) {
 
        SECTION( "difference in both attributes" ) {
            a.id++;
-           a.lexeme[2]++;
+           a.lexeme = "TOL";
 
            CHECK_FALSE( a == b );
            CHECK_FALSE( a <= b );
@@ -65,7 +65,7 @@ TEST_CASE( "Token relational operators", "[Token][relational]" ) {
        }
 
        SECTION( "difference on second attribute" ) {
-           b.lexeme[2]++;
+           b.lexeme = "TOL";
 
            CHECK_FALSE( a == b );
            CHECK      ( a <= b );
@@ -77,7 +77,7 @@ TEST_CASE( "Token relational operators", "[Token][relational]" ) {
 
        SECTION( "difference in both attributes" ) {
            b.id++;
-           b.lexeme[2]++;
+           b.lexeme = "TOL";
 
            CHECK_FALSE( a == b );
            CHECK      ( a <= b );
@@ -0,0 +1,47 @@
+/* transpiler.test.cpp
+ * Compares the output of the translated programs with the output of
+ * the interpreter, on the examples; examples/features and
+ * examples/failure exist for this test.
+ *
+ * This test runs the interpreter and the local g++ on the translated
+ * code; see execute.h.
+ */
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <catch.hpp>
+#include "execute.h"
+
+TEST_CASE( "Translated programs print what the interpreter prints", "[transpiler]" ) {
+    REQUIRE( std::ifstream("a.out") );
+    const char * binary = "test/transpiled";
+
+    /* The examples, and whether they can be run. */
+    std::pair<std::string, bool> examples[] = {
+        { "examples/peano", true },
+        { "examples/features", true },
+        { "examples/failure", false },
+    };
+    /* Folding computes closed subexpressions ahead of time,
+     * so every case is also translated without it. */
+    const char * options[] = {
+        "",
+        "--fold-budget 0 ",
+        "--fold-budget 0 --inline-limit 0 ",
+    };
+
+    for( const auto & example : examples )
+        for( std::string option : options ) {
+            INFO( "./a.out " << option << example.first );
+            /* The messages of the failures are compared too. */
+            Result run = execute( "./a.out " + option + example.first + " 2>&1" );
+            Result translated = execute( "./a.out -c " + option + example.first +
+                    " | g++ -std=c++11 -x c++ - -o " + binary + " && " + binary + " 2>&1" );
+            std::remove( binary );
+
+            CHECK( (run.status == 0) == example.second );
+            CHECK( (translated.status == 0) == example.second );
+            CHECK( translated.output == run.output );
+        }
+}
@@ -12,6 +12,7 @@
 
 #include <iosfwd>
 #include <string>
+#include "name.h"
 
 struct Token {
     enum {
@@ -41,7 +42,7 @@ struct Token {
     unsigned id;
 
     // Token lexeme: actual string that produced the token
-    std::string lexeme;
+    Name lexeme;
 
     // Source line and column of the token
     std::size_t line, column;
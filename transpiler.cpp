@@ -0,0 +1,289 @@
+/* transpiler.cpp
+ * Implementation of transpiler.h
+ */
+#include <climits>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "exceptions.h"
+#include "native.h"
+#include "transpiler.h"
+
+namespace {
+
+/* Definitions shared by every translated program. */
+const char runtime[] = R"(#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+struct semantic_error : public std::runtime_error {
+    semantic_error( const char * what ) :
+        runtime_error( what )
+    {}
+};
+
+class Value {
+    struct Pair;
+    long long number = 0;
+    std::shared_ptr<const Pair> pair;
+
+public:
+    explicit Value( long long number ) : number( number ) {}
+    Value( Value first, Value second );
+
+    bool is_pair() const { return bool(pair); }
+    long long value() const { return number; }
+    const Value & first() const;
+    const Value & second() const;
+    bool same( const Value & other ) const { return pair == other.pair; }
+};
+
+struct Value::Pair {
+    Value first, second;
+};
+
+inline Value::Value( Value first, Value second ) :
+    pair( std::make_shared<const Pair>( Pair{ std::move(first), std::move(second) } ) )
+{}
+inline const Value & Value::first() const { return pair->first; }
+inline const Value & Value::second() const { return pair->second; }
+
+bool operator==( const Value & lhs, const Value & rhs ) {
+    if( !lhs.is_pair() || !rhs.is_pair() )
+        return lhs.is_pair() == rhs.is_pair() && lhs.value() == rhs.value();
+    return lhs.same( rhs ) ||
+        (lhs.first() == rhs.first() && lhs.second() == rhs.second());
+}
+
+std::ostream & operator<<( std::ostream & os, const Value & value ) {
+    if( value.is_pair() )
+        return os << '{' << value.first() << ", " << value.second() << '}';
+    return os << value.value();
+}
+
+/* Binds the value to the slot of the pattern;
+ * returns false if the slot holds a different value. */
+inline bool bind( const Value *& slot, const Value & value ) {
+    if( !slot )
+        slot = &value;
+    return *slot == value;
+}
+
+/* Argument of a native operation. */
+inline long long number( const Value & value ) {
+    if( value.is_pair() )
+        throw semantic_error( "No valid overload found" );
+    return value.value();
+}
+
+inline long long divisor( long long y ) {
+    if( y == 0 )
+        throw semantic_error( "Division by zero" );
+    return y;
+}
+)";
+
+std::string literal( long long value ) {
+    if( value == LLONG_MIN )
+        return "(-" + std::to_string( LLONG_MAX ) + "LL - 1)";
+    return std::to_string( value ) + "LL";
+}
+
+struct Transpiler {
+    std::unordered_map<const Symbol *, unsigned> ids;
+    std::vector<std::pair<const Symbol *, unsigned>> operators; // Operators and arities.
+    std::unordered_map<const NativeBinaryNumericOperation *, unsigned> native_ids;
+    std::vector<const NativeBinaryNumericOperation *> natives;
+    std::vector<std::string> constants;
+    std::ostringstream functions;
+
+    /* Returns the name of the function of the operator. */
+    std::string function( const Symbol * op, unsigned arity ) {
+        auto pair = ids.emplace( op, operators.size() );
+        if( pair.second )
+            operators.emplace_back( op, arity );
+        return "op" + std::to_string( pair.first->second );
+    }
+
+    std::string native( const NativeBinaryNumericOperation * op ) {
+        auto pair = native_ids.emplace( op, natives.size() );
+        if( pair.second )
+            natives.push_back( op );
+        return "native" + std::to_string( pair.first->second );
+    }
+
+    std::string value( const Variable & var ) {
+        if( !var.is_pair() )
+            return "Value( " + literal( var.value() ) + " )";
+        return "Value( " + value( var.first() ) + ", " + value( var.second() ) + " )";
+    }
+
+    /* Declarations of the operands being translated; see operand(). */
+    std::string declarations;
+    unsigned temporaries = 0;
+
+    /* Expression that evaluates the body, once its operands are declared.
+     * C++ leaves the order of evaluation of the arguments of a call
+     * unspecified, but an operand that fails must prevent the evaluation
+     * of the ones at its right, as in the interpreter; thus, each operand
+     * is computed into a local variable, in source order. */
+    std::string expression( const OperatorBody & body ) {
+        switch( body.kind ) {
+            case OperatorBody::pair: {
+                auto & pair = static_cast<const PairBody &>( body );
+                std::string first = operand( *pair.first );
+                std::string second = operand( *pair.second );
+                return "Value( " + first + ", " + second + " )";
+            }
+            case OperatorBody::variable:
+                return "(*s[" + std::to_string( static_cast<const VariableBody &>( body ).slot ) + "])";
+            case OperatorBody::numeric:
+                return "Value( " + literal( static_cast<const NumericBody &>( body ).value ) + " )";
+            case OperatorBody::constant: {
+                const Variable & constant = static_cast<const ConstantBody &>( body ).value;
+                if( !constant.is_pair() )
+                    return value( constant );
+                constants.push_back( value( constant ) );
+                return "constant" + std::to_string( constants.size() - 1 );
+            }
+            case OperatorBody::nullary:
+                return function( static_cast<const NullaryTreeBody &>( body ).op, 0 ) + "()";
+            case OperatorBody::unary: {
+                auto & tree = static_cast<const UnaryTreeBody &>( body );
+                std::string variable = operand( *tree.variable );
+                return function( tree.op, 1 ) + "( " + variable + " )";
+            }
+            case OperatorBody::binary: {
+                auto & tree = static_cast<const BinaryTreeBody &>( body );
+                std::string left = operand( *tree.left );
+                std::string right = operand( *tree.right );
+                if( tree.op->overloads.size() == 1 )
+                    if( auto op = dynamic_cast<const NativeBinaryNumericOperation *>(
+                                tree.op->overloads[0]->body.get() ) )
+                        return "Value( " + native( op ) + "( number( " + left + " ), number( " + right + " ) ) )";
+                return function( tree.op, 2 ) + "( " + left + ", " + right + " )";
+            }
+            default:
+                throw semantic_error( "Cannot translate native operation to C++" );
+        }
+    }
+
+    /* Expression of an operand. Operands that may fail are declared as
+     * local variables; variables and constants are used in place. */
+    std::string operand( const OperatorBody & body ) {
+        std::string value = expression( body );
+        if( body.kind == OperatorBody::variable || body.kind == OperatorBody::numeric ||
+                body.kind == OperatorBody::constant )
+            return value;
+        std::string name = "t" + std::to_string( temporaries++ );
+        declarations += "            const Value " + name + " = " + value + ";\n";
+        return name;
+    }
+
+    /* Condition that matches the value against the pattern. */
+    std::string condition( const OperatorParameter & parameter, const std::string & value ) {
+        switch( parameter.kind ) {
+            case OperatorParameter::named: {
+                unsigned slot = static_cast<const NamedParameter &>( parameter ).slot;
+                return "bind( s[" + std::to_string( slot ) + "], " + value + " )";
+            }
+            case OperatorParameter::restricted: {
+                unsigned slot = static_cast<const RestrictedParameter &>( parameter ).slot;
+                return "!" + value + ".is_pair() && bind( s[" + std::to_string( slot ) + "], " + value + " )";
+            }
+            case OperatorParameter::numeric:
+                return "!" + value + ".is_pair() && " + value + ".value() == " +
+                    literal( static_cast<const NumericParameter &>( parameter ).value );
+            default: {
+                auto & pair = static_cast<const PairParameter &>( parameter );
+                return value + ".is_pair() && " +
+                    condition( *pair.first, value + ".first()" ) + " && " +
+                    condition( *pair.second, value + ".second()" );
+            }
+        }
+    }
+
+    std::string condition( const NullaryOverload & ) {
+        return "true";
+    }
+    std::string condition( const UnaryOverload & overload ) {
+        return condition( *overload.variable, "a0" );
+    }
+    std::string condition( const BinaryOverload & overload ) {
+        return condition( *overload.left, "a0" ) + " && " + condition( *overload.right, "a1" );
+    }
+
+    /* Statements that return the value of the body. */
+    std::string statement( const OperatorBody & body ) {
+        if( auto ptr = dynamic_cast<const NativeBinaryNumericOperation *>( &body ) )
+            return "            return Value( " + native( ptr ) + "( s[0]->value(), s[1]->value() ) );\n";
+        declarations.clear();
+        temporaries = 0;
+        std::string value = expression( body );
+        return declarations + "            return " + value + ";\n";
+    }
+
+    static const char * parameters( unsigned arity ) {
+        switch( arity ) {
+            case 0: return "()";
+            case 1: return "( const Value & a0 )";
+            default: return "( const Value & a0, const Value & a1 )";
+        }
+    }
+
+    template< typename Operator >
+    void translate( unsigned index ) {
+        auto op = static_cast<const Operator *>( operators[index].first );
+        functions << "\n// " << op->name << "\n"
+                  << "Value op" << index << parameters( operators[index].second ) << " {\n";
+        for( const auto & overload : op->overloads ) {
+            functions << "    do {\n";
+            if( overload->frame_size > 0 )
+                functions << "        const Value * s[" << overload->frame_size << "] = {};\n";
+            functions << "        if( !(" << condition( *overload ) << ") )\n"
+                      << "            break;\n"
+                      << "        try {\n"
+                      << statement( *overload->body )
+                      << "        } catch( semantic_error & ) {}\n"
+                      << "    } while( false );\n";
+        }
+        functions << "    throw semantic_error( \"No valid overload found\" );\n"
+                  << "}\n";
+    }
+
+    void write( std::ostream & os ) {
+        /* Translating an operator may discover new ones. */
+        for( unsigned i = 0; i < operators.size(); ++i )
+            switch( operators[i].second ) {
+                case 0: translate<NullaryOperator>( i ); break;
+                case 1: translate<UnaryOperator>( i ); break;
+                case 2: translate<BinaryOperator>( i ); break;
+            }
+
+        os << runtime << '\n';
+        for( unsigned i = 0; i < natives.size(); ++i )
+            os << "inline long long native" << i << "( long long x, long long y ) {\n"
+               << "    return " << natives[i]->source() << ";\n"
+               << "}\n";
+        for( unsigned i = 0; i < constants.size(); ++i )
+            os << "const Value constant" << i << " = " << constants[i] << ";\n";
+        os << '\n';
+        for( unsigned i = 0; i < operators.size(); ++i )
+            os << "Value op" << i << parameters( operators[i].second ) << ";\n";
+        os << functions.str()
+           << "\nint main() {\n"
+           << "    std::cout << op0() << std::endl;\n"
+           << "}\n";
+    }
+};
+
+} // anonymous namespace
+
+void transpileProgram( const NullaryOperator & entry, std::ostream & os ) {
+    Transpiler transpiler;
+    transpiler.function( &entry, 0 );
+    transpiler.write( os );
+}
@@ -0,0 +1,32 @@
+/* transpiler.h
+ * Translation of whole programs to C++.
+ *
+ * transpileProgram writes a standalone translation unit that computes
+ * and prints the value of the entry point, exactly as run_program does.
+ * It needs only the standard library; for instance,
+ *
+ *  ./a.out -c examples/peano > peano.cpp
+ *  g++ -std=c++11 -O2 peano.cpp -o peano
+ *
+ * Each operator reachable from the entry point becomes a function.
+ * Its overloads are tried in insertion order, each one as a pattern
+ * match followed by the evaluation of its body; a body that throws
+ * semantic_error makes the function try the next overload, as in
+ * the interpreter. Calls to native arithmetic are translated to inline
+ * arithmetic when the native is the only overload of its operator.
+ *
+ * Values are not hash-consed in the translated program; pairs are
+ * compared structurally. Like the tree walker, the translated program
+ * uses the C++ stack for recursion.
+ */
+#ifndef TRANSPILER_H
+#define TRANSPILER_H
+
+#include <ostream>
+#include "operator.h"
+
+/* Throws semantic_error if some operator reachable from the entry
+ * point has a native operation that cannot be translated. */
+void transpileProgram( const NullaryOperator & entry, std::ostream & );
+
+#endif // TRANSPILER_H
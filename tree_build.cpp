@@ -2,8 +2,7 @@
  * Implementation of tree_build.h.
  */
 #include <cstdlib>
-#include <typeinfo>
-#include <typeindex>
+#include <stdexcept>
 #include <unordered_map>
 #include "exceptions.h"
 #include "tree_build.h"
@@ -15,8 +14,10 @@ namespace {
      * NumericBody and TreeNodeBody. */
     std::unique_ptr<OperatorBody> buildExpressionTree( const OperatorBody&, const VariableList& );
 
-    /* Aggregates all the variables' names used inside the passed OperatorParameter. */
-    VariableList collectVariables( const OperatorParameter & );
+    /* Aggregates all the variables' names used inside the passed OperatorParameter,
+     * assigning a slot to each NamedParameter and RestrictedParameter in it. */
+    void insertVariables( OperatorParameter &, VariableList & );
+    VariableList collectVariables( OperatorParameter & );
 
 } // anonymous namespace
 
@@ -32,16 +33,16 @@ std::unique_ptr<UnaryOverload> buildUnaryTree( const OperatorDefinition& def ) {
     VariableList table;
     if( def.format[0] == 'f' ) {
         ptr->variable.reset(static_cast<const OperatorParameter&>(*def.names[1]).clone());
-        table = collectVariables( static_cast<const OperatorParameter&>(*def.names[1]) );
         ptr->name = static_cast<const OperatorName&>(*def.names[0]).name.lexeme;
     }
     else {
         ptr->variable.reset(static_cast<const OperatorParameter&>(*def.names[0]).clone());
-        table = collectVariables( static_cast<const OperatorParameter&>(*def.names[0]) );
         ptr->name = static_cast<const OperatorName&>(*def.names[1]).name.lexeme;
     }
+    table = collectVariables( *ptr->variable );
 
     ptr->body = std::move( buildExpressionTree(*def.body, table) );
+    ptr->frame_size = table.size();
     return std::move( ptr );
 }
 
@@ -50,17 +51,14 @@ std::unique_ptr<BinaryOverload> buildBinaryTree( const OperatorDefinition& def )
     ptr->left.reset(static_cast<OperatorParameter&>( *def.names[0] ).clone());
     ptr->name = static_cast<OperatorName&>(*def.names[1]).name.lexeme;
     ptr->right.reset(static_cast<OperatorParameter&>( *def.names[2] ).clone());
-    auto table = collectVariables( *ptr->left ).merge(collectVariables( *ptr->right ));
+    auto table = collectVariables( *ptr->left );
+    insertVariables( *ptr->right, table );
     ptr->body = std::move( buildExpressionTree(*def.body, table) );
+    ptr->frame_size = table.size();
     return std::move( ptr );
 }
 
 namespace {
-typedef std::unique_ptr<OperatorBody> (*ExpressionTreeBuilder)(
-        const OperatorBody&,
-        const VariableList&
-    );
-
 std::unique_ptr<OperatorBody> buildExpressionPairBody(
         const PairBody& body,
         const VariableList& table )
@@ -71,18 +69,283 @@ std::unique_ptr<OperatorBody> buildExpressionPairBody(
             );
 }
 
+/* Classification of an element of a SequenceBody: its tree, if it is
+ * a valid operand, and the operators it names, if it is a TerminalBody.
+ * The priorities are copied from the operators, so that parsing reads
+ * nothing but these records. */
+struct Element {
+    std::unique_ptr<OperatorBody> operand = nullptr;
+    unsigned priority = -1; // Priority of the operand.
+
+    const UnaryOperator * prefix = nullptr;
+    unsigned prefix_priority;
+    unsigned prefix_operand; // Maximum priority of the operand.
+
+    const UnaryOperator * postfix = nullptr;
+    unsigned postfix_priority;
+    unsigned postfix_operand;
+
+    const BinaryOperator * binary = nullptr;
+    unsigned binary_priority;
+    unsigned binary_left;
+    unsigned binary_right;
+};
+
+/* Classifies each element of the sequence, building the operands. */
+std::vector<Element> classifyElements( const SequenceBody& body, const VariableList& table ) {
+    std::vector<Element> elements( body.sequence.size() );
+    for( unsigned i = 0; i < body.sequence.size(); ++i ) {
+        Element & element = elements[i];
+        try {
+            element.operand = std::move( buildExpressionTree(*body.sequence[i], table) );
+            if( element.operand->kind == OperatorBody::nullary )
+                element.priority = static_cast<const NullaryTreeBody &>( *element.operand ).op->priority;
+            else
+                element.priority = 0;
+        } catch( semantic_error & ) {
+            /* The occurrence of an exception means that the tree below body.sequence[i]
+             * cannot be parsed properly as a single atom, so we are correct
+             * to keep the default invalid state. */
+        }
+
+        if( body.sequence[i]->kind != OperatorBody::terminal )
+            continue;
+        Name name = static_cast<const TerminalBody &>( *body.sequence[i] ).name.lexeme;
+        if( auto op = SymbolTable::retrievePrefixOperator( name ) ) {
+            element.prefix = op;
+            element.prefix_priority = op->priority;
+            element.prefix_operand = op->operand_priority;
+        }
+        if( auto op = SymbolTable::retrievePostfixOperator( name ) ) {
+            element.postfix = op;
+            element.postfix_priority = op->priority;
+            element.postfix_operand = op->operand_priority;
+        }
+        if( auto op = SymbolTable::retrieveBinaryOperator( name ) ) {
+            element.binary = op;
+            element.binary_priority = op->priority;
+            element.binary_left = op->left_priority;
+            element.binary_right = op->right_priority;
+        }
+    }
+    return elements;
+}
+
+enum Role { Operand, Prefix, Postfix, Binary };
+
+/* Linear-time parser for the sequences that have a single possible
+ * parse tree, by precedence climbing.
+ *
+ * The parser only accepts a sequence if each element has a single role
+ * (operand, prefix, postfix or binary operator), and if no priority
+ * has both an operator that accepts an operand of its own priority at
+ * its left (yfx, yf) and one that accepts it at its right (xfy, fy).
+ * Since an operand never has greater priority than its operator, the
+ * root of a parse tree is one of the operators of greatest priority
+ * in the sequence; under these conditions, only the leftmost or only
+ * the rightmost of them may be the root, so every subsequence has at
+ * most one parse tree. That is the tree found by the dynamic program
+ * in buildExpressionSequenceBody, which we just find faster.
+ *
+ * If the parser rejects the sequence, nothing is known about it. */
+class PrecedenceParser {
+    struct Item {
+        Role role;
+        unsigned priority;
+        unsigned left; // Maximum priority of the left operand.
+        unsigned right; // Maximum priority of the right operand.
+    };
+
+    std::vector<Element> & elements;
+    std::vector<Item> items;
+    std::vector<unsigned> output; // Elements in postfix order.
+    unsigned next = 0;
+
+    /* Parses the longest expression, starting at 'next', whose priority
+     * is at most 'limit'; its priority is stored in 'priority'. */
+    bool parse( unsigned limit, unsigned & priority ) {
+        if( next == items.size() )
+            return false;
+        const Item & first = items[next];
+        if( first.role == Prefix ) {
+            unsigned index = next++;
+            unsigned operand;
+            if( !parse( first.right, operand ) )
+                return false;
+            output.push_back( index );
+        }
+        else if( first.role == Operand )
+            output.push_back( next++ );
+        else
+            return false;
+        priority = first.priority;
+
+        while( next < items.size() ) {
+            const Item & op = items[next];
+            if( op.role != Postfix && op.role != Binary )
+                break;
+            if( priority > op.left || op.priority > limit )
+                break;
+            unsigned index = next++;
+            unsigned operand;
+            if( op.role == Binary && !parse( op.right, operand ) )
+                return false;
+            output.push_back( index );
+            priority = op.priority;
+        }
+        return priority <= limit;
+    }
+
+public:
+    explicit PrecedenceParser( std::vector<Element> & elements ) :
+        elements( elements ),
+        items( elements.size() )
+    {}
+
+    /* Assigns a role to each element; returns false if the sequence
+     * does not meet the conditions above. */
+    bool classify() {
+        /* Bit 1 of open[p] is set if some operator of priority p accepts
+         * an operand of priority p at its left, and bit 2 at its right. */
+        std::unordered_map<unsigned, unsigned> open;
+        for( unsigned i = 0; i < items.size(); ++i ) {
+            const Element & element = elements[i];
+            Item & item = items[i];
+            unsigned roles = 0;
+            if( element.operand ) {
+                item = { Operand, element.priority, 0, 0 };
+                ++roles;
+            }
+            if( element.prefix ) {
+                item = { Prefix, element.prefix_priority, -1u, element.prefix_operand };
+                ++roles;
+            }
+            if( element.postfix ) {
+                item = { Postfix, element.postfix_priority, element.postfix_operand, -1u };
+                ++roles;
+            }
+            if( element.binary ) {
+                item = { Binary, element.binary_priority, element.binary_left,
+                    element.binary_right };
+                ++roles;
+            }
+            if( roles != 1 )
+                return false;
+            if( item.role == Operand )
+                continue;
+
+            /* Operators of priority 0 and type x accept any operand. */
+            if( item.role != Prefix ) {
+                if( item.left > item.priority )
+                    return false;
+                if( item.left == item.priority )
+                    open[item.priority] |= 1;
+            }
+            if( item.role != Postfix ) {
+                if( item.right > item.priority )
+                    return false;
+                if( item.right == item.priority )
+                    open[item.priority] |= 2;
+            }
+            if( open[item.priority] == 3 )
+                return false;
+        }
+        return true;
+    }
+
+    /* Returns the parse tree of the sequence, or nullptr if
+     * no tree was found; the operands are moved into the tree. */
+    std::unique_ptr<OperatorBody> build() {
+        unsigned priority;
+        if( !parse( -1u, priority ) || next != items.size() )
+            return nullptr;
+
+        std::vector<std::unique_ptr<OperatorBody>> stack;
+        for( unsigned i : output ) {
+            Element & element = elements[i];
+            switch( items[i].role ) {
+                case Operand:
+                    stack.push_back( std::move(element.operand) );
+                    break;
+                case Prefix:
+                    stack.back() = std::make_unique<UnaryTreeBody>(
+                            element.prefix, std::move(stack.back()) );
+                    break;
+                case Postfix:
+                    stack.back() = std::make_unique<UnaryTreeBody>(
+                            element.postfix, std::move(stack.back()) );
+                    break;
+                case Binary: {
+                    auto right = std::move( stack.back() );
+                    stack.pop_back();
+                    stack.back() = std::make_unique<BinaryTreeBody>(
+                            element.binary, std::move(stack.back()), std::move(right) );
+                    break;
+                }
+            }
+        }
+        return std::move( stack.back() );
+    }
+};
+
+/* Entry of the dynamic program in buildExpressionSequenceBody.
+ * Rather than the parse tree of the subsequence, it stores the root of
+ * the tree; the subtrees are in other entries. Only the tree of the
+ * whole sequence is built, at the end. */
+struct Parse {
+    bool valid = false;
+    bool found = false; // Some parse was found, even if 'valid' is false.
+    unsigned priority = -1;
+    Role root;
+    unsigned split; // Position of the root, if it is a binary operator.
+};
+
+/* Builds the tree of dp[i][j], moving the operands into it. */
+std::unique_ptr<OperatorBody> buildParse(
+        const std::vector<std::vector<Parse>> & dp,
+        std::vector<Element> & elements,
+        unsigned i, unsigned j )
+{
+    const Parse & parse = dp[i][j];
+    switch( parse.root ) {
+        case Operand:
+            return std::move( elements[i].operand );
+        case Prefix:
+            return std::make_unique<UnaryTreeBody>(
+                    elements[i].prefix, buildParse( dp, elements, i+1, j ) );
+        case Postfix:
+            return std::make_unique<UnaryTreeBody>(
+                    elements[j].postfix, buildParse( dp, elements, i, j-1 ) );
+        case Binary:
+            break;
+    }
+    unsigned k = parse.split;
+    auto left = buildParse( dp, elements, i, k-1 );
+    return std::make_unique<BinaryTreeBody>(
+            elements[k].binary, std::move(left), buildParse( dp, elements, k+1, j ) );
+}
+
 std::unique_ptr<OperatorBody> buildExpressionSequenceBody(
         const SequenceBody& body,
         const VariableList& table )
 {
-    struct Data {
-        std::unique_ptr< OperatorBody > data = nullptr;
-        bool valid = false;
-        unsigned priority = -1;
-    };
-    std::vector<std::vector<Data>> dp;
+    std::vector<Element> elements = classifyElements( body, table );
+
+    /* Most sequences are parsed by precedence climbing;
+     * the dynamic program below handles the others. */
+    PrecedenceParser parser( elements );
+    if( parser.classify() )
+        if( auto tree = parser.build() )
+            return tree;
+
+    std::vector<std::vector<Parse>> dp;
     for( unsigned i = 0; i < body.sequence.size(); i++ ) {
-        dp.emplace_back( std::vector<Data>( body.sequence.size() ) );
+        dp.emplace_back( std::vector<Parse>( body.sequence.size() ) );
+        if( elements[i].operand ) {
+            dp[i][i].valid = dp[i][i].found = true;
+            dp[i][i].priority = elements[i].priority;
+            dp[i][i].root = Operand;
+        }
     }
     /* dp[i][j] represents the parse tree for the subsequence
      * consisting of the 'tokens' body.sequence[i, i+1, ..., j].
@@ -91,92 +354,57 @@ std::unique_ptr<OperatorBody> buildExpressionSequenceBody(
      * Although it is possible to parse around this limitations, the algorithm
      * is even more complex than the one presented here. */
 
-    for( unsigned i = 0; i < body.sequence.size(); ++i )
-        try {
-            dp[i][i].data = std::move( buildExpressionTree(*body.sequence[i], table) );
-            dp[i][i].valid = true;
-            if( auto op = dynamic_cast<const NullaryTreeBody *>( dp[i][i].data.get() ) )
-                dp[i][i].priority = SymbolTable::nullaryOperatorPriority(op->op->name);
-            else
-                dp[i][i].priority = 0;
-        } catch( semantic_error & ) {
-            /* The occurrence of an exception means that the tree below body.sequence[i]
-             * cannot be parsed properly as a single atom, so we are correct
-             * to keep the default invalid state. */
-        }
-
     for( unsigned d = 1; d < body.sequence.size(); ++d )
         for( unsigned i = 0, j = d + i; j < body.sequence.size(); ++i, ++j ) {
             /* First, let's try to interpret sequence[i, i+1,...,j] as a prefix
              * operator followed by its operands. */
-            if( const TerminalBody * tbody = !dp[i+1][j].valid ? nullptr :
-                                        dynamic_cast<const TerminalBody*>(body.sequence[i].get()))
-            {
-                std::string name = tbody->name.lexeme;
-                if( SymbolTable::existsPrefixOperator(name) &&
-                    dp[i+1][j].priority <= SymbolTable::maximumPrefixPriority(name) )
-                {
-                    dp[i][j].data = std::move( std::make_unique<UnaryTreeBody>(
-                            SymbolTable::retrievePrefixOperator(name),
-                            dp[i+1][j].data->clone()
-                        ) );
-                    dp[i][j].priority = SymbolTable::prefixOperatorPriority(name);
-                    dp[i][j].valid = true;
+            if( dp[i+1][j].valid && elements[i].prefix ) {
+                if( dp[i+1][j].priority <= elements[i].prefix_operand ) {
+                    dp[i][j].root = Prefix;
+                    dp[i][j].priority = elements[i].prefix_priority;
+                    dp[i][j].valid = dp[i][j].found = true;
                 }
             }
             /* Now, we will try an interpretation as postfix operator. */
-            if( const TerminalBody * tbody = !dp[i][j-1].valid ? nullptr :
-                                        dynamic_cast<const TerminalBody*>(body.sequence[j].get()))
-            {
-                std::string name = tbody->name.lexeme;
-                if( SymbolTable::existsPostfixOperator(name) &&
-                    dp[i][j-1].priority <= SymbolTable::maximumPostfixPriority(name) )
-                {
+            if( dp[i][j-1].valid && elements[j].postfix ) {
+                if( dp[i][j-1].priority <= elements[j].postfix_operand ) {
                     if( dp[i][j].valid ) {
                         dp[i][j].valid = false;
                         continue;
                     }
-                    dp[i][j].data = std::move( std::make_unique<UnaryTreeBody>(
-                            SymbolTable::retrievePostfixOperator(name),
-                            dp[i][j-1].data->clone()
-                        ) );
-                    dp[i][j].priority = SymbolTable::postfixOperatorPriority(name);
-                    dp[i][j].valid = true;
+                    dp[i][j].root = Postfix;
+                    dp[i][j].priority = elements[j].postfix_priority;
+                    dp[i][j].valid = dp[i][j].found = true;
                 }
             }
             /* Finnaly, binary overloads.
              * We are updating dp[i][j] and will try to form a new parse
-             * tree whose root is the operator at body.sequence[k]. */
+             * tree whose root is the operator at body.sequence[k].
+             *
+             * Note that the left operand is used even if it is ambiguous;
+             * its first parse is taken. */
             for( unsigned k = i+1; k <= j-1; ++k )
-                if( const TerminalBody * tbody = !dp[k+1][j].valid ? nullptr :
-                                            dynamic_cast<const TerminalBody*>(body.sequence[k].get()))
-                {
-                    std::string name = tbody->name.lexeme;
-                    if( SymbolTable::existsBinaryOperator(name)
-                     && dp[i][k-1].priority <= SymbolTable::maximumLeftPriority(name)
-                     && dp[k+1][j].priority <= SymbolTable::maximumRightPriority(name))
+                if( dp[k+1][j].valid && elements[k].binary ) {
+                    if( dp[i][k-1].found
+                     && dp[i][k-1].priority <= elements[k].binary_left
+                     && dp[k+1][j].priority <= elements[k].binary_right )
                     {
                         if( dp[i][j].valid ) {
                             dp[i][j].valid = false;
-                            goto end_external_loop;
+                            break;
                         }
-                        dp[i][j].data = std::move( std::make_unique<BinaryTreeBody>(
-                            SymbolTable::retrieveBinaryOperator(name),
-                            dp[i][k-1].data->clone(),
-                            dp[k+1][j].data->clone()
-                            ) );
-                        dp[i][j].valid = true;
-                        dp[i][j].priority = SymbolTable::binaryOperatorPriority(name);
+                        dp[i][j].root = Binary;
+                        dp[i][j].split = k;
+                        dp[i][j].valid = dp[i][j].found = true;
+                        dp[i][j].priority = elements[k].binary_priority;
                     }
                 }
-
-end_external_loop:;
         }
 
     if( !dp[0][body.sequence.size()-1].valid )
         throw semantic_error( "No viable semantic parsing found for given operators." );
 
-    return std::move( dp[0][body.sequence.size()-1].data );
+    return buildParse( dp, elements, 0, body.sequence.size() - 1 );
 }
 
 std::unique_ptr<OperatorBody> buildExpressionTerminalBody(
@@ -188,7 +416,7 @@ std::unique_ptr<OperatorBody> buildExpressionTerminalBody(
                 std::strtoll( body.name.lexeme.c_str(), 0, 10 ) // porque foda-se o Melga
         );
     if( table.contains( body.name.lexeme ) )
-        return std::make_unique<VariableBody>( body.name.lexeme );
+        return std::make_unique<VariableBody>( body.name.lexeme, table.slot(body.name.lexeme) );
 
     if( SymbolTable::existsNullaryOperator(body.name.lexeme) )
         return std::make_unique<NullaryTreeBody>(
@@ -198,76 +426,52 @@ std::unique_ptr<OperatorBody> buildExpressionTerminalBody(
     if( SymbolTable::existsCategory(body.name.lexeme) )
         return std::make_unique<NumericBody>( SymbolTable::categoryValue(body.name.lexeme));
 
-    throw semantic_error( "Terminal " + body.name.lexeme + "is not a number,"
+    throw semantic_error( "Terminal " + body.name.lexeme.str() + "is not a number,"
             " a variable or a unary operator." );
 }
 
 
-#define AUX_TYPE(type)                                                                              \
-    {                                                                                               \
-        std::type_index(typeid(type)),                                                              \
-        static_cast<ExpressionTreeBuilder>(                                                         \
-            []( const OperatorBody& body, const VariableList& table ) {                             \
-                return std::move(buildExpression##type( dynamic_cast<const type&>(body), table));   \
-            }                                                                                       \
-        )                                                                                           \
-    }
-
 std::unique_ptr<OperatorBody> buildExpressionTree(
         const OperatorBody& body,
         const VariableList& table )
 {
-    std::unordered_map<std::type_index, ExpressionTreeBuilder> functions = {
-        AUX_TYPE(PairBody),
-        AUX_TYPE(SequenceBody),
-        AUX_TYPE(TerminalBody),
-    };
-    return std::move( functions.at(std::type_index(typeid(body)))(body, table) );
+    switch( body.kind ) {
+        case OperatorBody::pair:
+            return buildExpressionPairBody( static_cast<const PairBody&>(body), table );
+        case OperatorBody::sequence:
+            return buildExpressionSequenceBody( static_cast<const SequenceBody&>(body), table );
+        case OperatorBody::terminal:
+            return buildExpressionTerminalBody( static_cast<const TerminalBody&>(body), table );
+        default:
+            throw std::logic_error( "buildExpressionTree called on an analysed body" );
+    }
 }
 
-typedef void(* InsertorFunction )( const OperatorParameter &, VariableList & );
-
-void insertVariables( const OperatorParameter & var, VariableList & table ) {
-    // A 'switch-case' with types
-    static std::unordered_map<std::type_index, InsertorFunction > jump_table =
-    {
-        {
-            std::type_index(typeid(NamedParameter)),
-            static_cast<InsertorFunction>(
-                []( const OperatorParameter & var, VariableList & table ) {
-                    auto & nvar = dynamic_cast<const NamedParameter&>(var);
-                    table.insert( nvar.name.lexeme );
-                })
-        },
-        {
-            std::type_index(typeid(RestrictedParameter)),
-            static_cast<InsertorFunction>(
-                []( const OperatorParameter & var, VariableList & table ) {
-                    auto & nvar = dynamic_cast<const RestrictedParameter&>(var);
-                    table.insert( nvar.name.lexeme );
-                })
-        },
-        {
-            std::type_index(typeid(NumericParameter)),
-            static_cast<InsertorFunction>(
-                []( const OperatorParameter &, VariableList & ) {
-                    // We do not need to save numbers in the symbol table.
-                })
-        },
-        {
-            std::type_index(typeid(PairParameter)),
-            static_cast<InsertorFunction>(
-                []( const OperatorParameter & var, VariableList & table ) {
-                    auto & nvar = dynamic_cast<const PairParameter&>(var);
-                    insertVariables( *nvar.first, table );
-                    insertVariables( *nvar.second, table );
-                })
-        },
-    };
-    jump_table.at(typeid(var))( var, table );
+void insertVariables( OperatorParameter & var, VariableList & table ) {
+    switch( var.kind ) {
+        case OperatorParameter::named: {
+            auto & nvar = static_cast<NamedParameter&>(var);
+            nvar.slot = table.insert( nvar.name.lexeme );
+            break;
+        }
+        case OperatorParameter::restricted: {
+            auto & nvar = static_cast<RestrictedParameter&>(var);
+            nvar.slot = table.insert( nvar.name.lexeme );
+            break;
+        }
+        case OperatorParameter::numeric:
+            // We do not need to save numbers in the symbol table.
+            break;
+        case OperatorParameter::pair: {
+            auto & nvar = static_cast<PairParameter&>(var);
+            insertVariables( *nvar.first, table );
+            insertVariables( *nvar.second, table );
+            break;
+        }
+    }
 }
 
-VariableList collectVariables( const OperatorParameter & var ) {
+VariableList collectVariables( OperatorParameter & var ) {
     VariableList table;
     insertVariables( var, table );
     return table;
@@ -1,61 +1,289 @@
 /* variable.cpp
  * Implementation of variable.h
  */
+#include <new>
 #include <ostream>
+#include <unordered_map>
 #include <utility>
-#include "exceptions.h"
+#include <vector>
 #include "variable.h"
 
-Variable::Variable( std::unique_ptr<Variable>&& f, std::unique_ptr<Variable>&& s ) :
-    first( std::move(f) ),
-    second( std::move(s) )
+/* A VariableStore owns a hash-consing table and the cells in it.
+ * The heap store is the root of a tree of stores; each VariablePool
+ * adds a new store below the active one, and each VariableFork adds
+ * two. Stores other than the heap allocate their cells from an arena.
+ *
+ * Lookups walk the chain from the active store to the heap, so every
+ * value still exists at most once in the chain. New cells are always
+ * created in the active store, that is the last store of the chain.
+ * Every cell in a store is in exactly one bucket, chained through Node::next.
+ * Inline integers never reach the store. */
+class VariableStore {
+    typedef Variable::Node Node;
+    static const std::size_t chunk_size = 4096;
+
+    VariableStore * parent;
+    std::vector<Node *> buckets;
+    std::size_t size = 0;
+
+    // Arena; unused by the heap store.
+    std::vector<Node *> chunks;
+    std::size_t chunk_used = chunk_size;
+
+    /* 'buckets' must be a power of two. */
+    VariableStore( VariableStore * parent, std::size_t buckets ) :
+        parent( parent ),
+        buckets( buckets, nullptr )
+    {}
+
+    Node *& bucket( std::size_t hash ) {
+        return buckets[hash & (buckets.size() - 1)];
+    }
+    void link( Node * node ) {
+        Node *& head = bucket( node->hash );
+        node->next = head;
+        head = node;
+        if( ++size > buckets.size() )
+            grow();
+    }
+    void grow() {
+        std::vector<Node *> old( buckets.size() * 2, nullptr );
+        std::swap( old, buckets );
+        for( Node * node : old )
+            while( node ) {
+                Node * next = node->next;
+                Node *& head = bucket( node->hash );
+                node->next = head;
+                head = node;
+                node = next;
+            }
+    }
+
+    Node * allocate() {
+        if( this == heap() )
+            return static_cast<Node *>( ::operator new( sizeof(Node) ) );
+        if( chunk_used == chunk_size ) {
+            chunks.push_back( static_cast<Node *>( ::operator new( chunk_size * sizeof(Node) ) ) );
+            chunk_used = 0;
+        }
+        return chunks.back() + chunk_used++;
+    }
+
+    Node * create( std::size_t hash, bool pair, long long value,
+            const Variable& first, const Variable& second )
+    {
+        Node * node = new (allocate()) Node{
+            {1}, hash, nullptr, this, this == heap(), pair, value, first, second };
+        link( node );
+        return node;
+    }
+
+    static Node * acquire( Node * node ) {
+        if( node->counted )
+            node->references.fetch_add( 1, std::memory_order_relaxed );
+        return node;
+    }
+
+public:
+    /* Null stands for the heap, so that 'active' needs no
+     * dynamic initialization in each thread. */
+    static thread_local VariableStore * active;
+
+    /* The heap store is never destroyed, so that variables with static
+     * storage duration can be safely released at program exit. */
+    static VariableStore * heap() {
+        static VariableStore * store = new VariableStore( nullptr, 1024 );
+        return store;
+    }
+
+    static VariableStore * current() {
+        return active ? active : heap();
+    }
+
+    /* Creates a store below the active one; pools expect
+     * more cells than the branches of a fork. */
+    static VariableStore * make( std::size_t buckets ) {
+        return new VariableStore( current(), buckets );
+    }
+
+    /* Releases the references that cells of the store hold to cells
+     * of other stores, then frees the arena in bulk. */
+    static void release( VariableStore * store ) {
+        for( Node * chunk : store->chunks ) {
+            std::size_t used = chunk == store->chunks.back() ? store->chunk_used : chunk_size;
+            for( Node * node = chunk; node != chunk + used; ++node ) {
+                for( Variable * child : {&node->first, &node->second} )
+                    if( child->is_cell() && child->node()->store == store )
+                        child->word = 0;
+                node->~Node();
+            }
+            ::operator delete( chunk );
+        }
+        delete store;
+    }
+
+    static VariableStore * parent_of( VariableStore * store ) {
+        return store->parent;
+    }
+
+    static Node * number( long long value ) {
+        std::size_t hash = Variable::mix( value );
+        for( VariableStore * store = current(); store; store = store->parent )
+            for( Node * node = store->bucket( hash ); node; node = node->next )
+                if( !node->pair && node->value == value )
+                    return acquire( node );
+        return current()->create( hash, false, value, Variable(), Variable() );
+    }
+
+    static Node * pair( const Variable& first, const Variable& second ) {
+        std::size_t hash = Variable::mix( first.hash() * 31 + second.hash() );
+        for( VariableStore * store = current(); store; store = store->parent )
+            for( Node * node = store->bucket( hash ); node; node = node->next )
+                if( node->pair && node->first == first && node->second == second )
+                    return acquire( node );
+        return current()->create( hash, true, 0, first, second );
+    }
+
+    /* Returns a copy of the variable whose cells are not in the store.
+     * The copy is built bottom-up, with an explicit stack, in the active
+     * store; shared pairs are copied only once. */
+    static Variable copy( const Variable& var, const VariableStore * store ) {
+        std::unordered_map<const Node *, Variable> copied;
+        std::vector<std::pair<const Variable *, bool>> pending{ {&var, false} };
+        std::vector<Variable> done;
+        while( !pending.empty() ) {
+            const Variable & item = *pending.back().first;
+            bool expanded = pending.back().second;
+            pending.pop_back();
+
+            if( !item.is_cell() || item.node()->store != store )
+                done.push_back( item );
+            else if( !item.is_pair() )
+                done.push_back( Variable(item.value()) );
+            else if( copied.count(item.node()) )
+                done.push_back( copied[item.node()] );
+            else if( !expanded ) {
+                pending.emplace_back( &item, true );
+                pending.emplace_back( &item.second(), false );
+                pending.emplace_back( &item.first(), false );
+            }
+            else {
+                Variable second = std::move( done.back() );
+                done.pop_back();
+                Variable first = std::move( done.back() );
+                done.pop_back();
+                done.emplace_back( first, second );
+                copied.emplace( item.node(), done.back() );
+            }
+        }
+        return std::move( done.back() );
+    }
+
+    void unlink( Node * node ) {
+        Node ** ptr = &bucket( node->hash );
+        while( *ptr != node )
+            ptr = &(*ptr)->next;
+        *ptr = node->next;
+        --size;
+    }
+};
+
+thread_local VariableStore * VariableStore::active = nullptr;
+
+static_assert( sizeof(Variable) == sizeof(void *), "Variable must be a single word" );
+
+Variable::Node * Variable::box( long long value ) {
+    return VariableStore::number( value );
+}
+
+Variable::Variable( const Variable& first, const Variable& second ) :
+    Variable( VariableStore::pair(first, second) )
 {}
 
-Variable::Variable( long long value ) :
-    first( nullptr ),
-    value( value )
+void Variable::destroy( Node * node ) {
+    /* Pool cells are only freed with the whole pool. */
+    if( node->store != VariableStore::heap() )
+        return;
+
+    /* Long lists would overflow the stack if the nodes were
+     * released recursively, so we keep an explicit worklist. */
+    static std::vector<Node *> & pending = *new std::vector<Node *>;
+    pending.push_back( node );
+    while( !pending.empty() ) {
+        Node * ptr = pending.back();
+        pending.pop_back();
+        VariableStore::heap()->unlink( ptr );
+        if( ptr->pair )
+            for( Variable * child : {&ptr->first, &ptr->second} ) {
+                if( child->is_cell() && child->node()->counted &&
+                        child->node()->references.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+                    pending.push_back( child->node() );
+                child->word = 0;
+            }
+        ptr->~Node();
+        ::operator delete( ptr );
+    }
+}
+
+VariablePool::VariablePool() :
+    store( VariableStore::active = VariableStore::make( 1024 ) )
 {}
 
-Variable::~Variable() {
-    if( first ) second.reset();
+void (*VariablePool::on_release)() = nullptr;
+
+VariablePool::~VariablePool() {
+    if( on_release )
+        on_release();
+    VariableStore::active = VariableStore::parent_of( store );
+    VariableStore::release( store );
 }
 
-std::unique_ptr<Variable> Variable::clone() const {
-    if( !first ) return std::make_unique<Variable>( value );
-    return std::make_unique<Variable>(
-            std::move( first->clone() ),
-            std::move( second->clone() )
-        );
+namespace {
+    /* Activates the store during the lifetime of the object. */
+    struct Activate {
+        VariableStore * previous = VariableStore::active;
+        Activate( VariableStore * store ) { VariableStore::active = store; }
+        ~Activate() { VariableStore::active = previous; }
+    };
+} // anonymous namespace
+
+Variable VariablePool::copy_out( const Variable& var ) const {
+    Activate activate( VariableStore::parent_of(store) );
+    return VariableStore::copy( var, store );
 }
 
-bool operator==( const Variable& lhs, const Variable& rhs ) {
-    if( lhs.first )
-        return rhs.first &&
-                *lhs.first == *rhs.first &&
-                *lhs.second == *rhs.second;
-    return !rhs.first &&
-        lhs.value == rhs.value;
+VariableFork::VariableFork() :
+    base( VariableStore::active ),
+    branches{ VariableStore::make( 64 ), VariableStore::make( 64 ) }
+{
+    VariableStore::active = branches[0];
 }
 
-std::ostream& operator<<( std::ostream & os, const Variable& var ) {
-    if( var.first ) return os << '{' << *var.first << ", " << *var.second << '}';
-    return os << var.value;
+VariableFork::~VariableFork() {
+    VariableStore::active = base;
+    VariableStore::release( branches[0] );
+    VariableStore::release( branches[1] );
 }
 
-void VariableTable::insert( std::string name, std::unique_ptr<Variable>&& variable ) {
-    auto pair = table.insert( std::make_pair(name, variable->clone()) );
-    if( pair.second ) {
-        // Insertion failed: this variable exists.
-        if( *pair.first->second == *variable )
-            return; // Ok: the values are the same.
-        throw semantic_error( "Variable already inserted with different value" );
-    }
+VariableFork::Branch::Branch( VariableFork & fork ) :
+    previous( VariableStore::active )
+{
+    VariableStore::active = fork.branches[1];
 }
 
-std::unique_ptr<Variable> VariableTable::retrieve( std::string name ) const {
-    try {
-        return table.at(name)->clone();
-    } catch( std::out_of_range & ) {
-        throw semantic_error( "Inexistent variable" );
-    }
+VariableFork::Branch::~Branch() {
+    VariableStore::active = previous;
+}
+
+std::pair<Variable, Variable> VariableFork::join(
+        const Variable& first, const Variable& second )
+{
+    VariableStore::active = base;
+    return { VariableStore::copy( first, branches[0] ),
+             VariableStore::copy( second, branches[1] ) };
+}
+
+std::ostream& operator<<( std::ostream & os, const Variable& var ) {
+    if( var.is_pair() ) return os << '{' << var.first() << ", " << var.second() << '}';
+    return os << var.value();
 }
@@ -2,71 +2,316 @@
  * Structure used to pass data around the program.
  *
  * A variable can be either an integer value, or a pair of variables
- * (they are recursive). The actual definition is as a struct whose
- * first member is a pointer, and whose second member is a union
- * between a pointer and a integer. If the first pointer is null,
- * then the active member of the union is the integer, otherwise
- * is the pointer that is the active member.
+ * (they are recursive).
  *
- * Since the active member is set at construction, this information
- * should not change in the execution of the program.
+ * Variables are immutable and hash-consed: every distinct value
+ * exists at most once in memory, and a Variable is merely a
+ * handle to it. Thus, copying a Variable is O(1), identical
+ * sub-tuples share storage and two variables are equal if and
+ * only if their handles are equal.
+ *
+ * The handle is a single tagged word. If the lowest bit is set,
+ * the remaining bits hold the integer itself; this is the case for
+ * every integer that fits in 63 bits (on 64-bit machines).
+ * Otherwise, the word is a pointer to a reference-counted cell, that
+ * holds either a pair (two handles) or a boxed integer too large to
+ * be stored inline.
+ *
+ * A default-constructed Variable is null (its word is zero): it does
+ * not refer to any value. Only assignment, destruction and the boolean
+ * test are valid operations on a null Variable.
+ *
+ * Cells are normally allocated on the heap and freed when their last
+ * reference dies. While a VariablePool is alive, however, new cells
+ * are allocated from that pool instead, and are only freed, in bulk,
+ * when the pool is destroyed; only heap cells count their references.
+ *
+ * The active pool is per thread. Threads may share values through a
+ * VariableFork; the reference counts of heap cells are atomic, but the
+ * heap itself is not synchronized, so no heap cell may be created or
+ * freed while a fork is running.
  */
 #ifndef VARIABLE_H
 #define VARIABLE_H
 
-#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <iosfwd>
-#include <string>
-#include <unordered_map>
-
-struct Variable {
-    std::unique_ptr<Variable> first;
-    union {
-        std::unique_ptr<Variable> second; // active if first != nullptr
-        long long value; // active is first == nullptr
-    };
+#include <memory>
+#include <utility>
+
+class VariableStore;
+
+class Variable {
+    struct Node;
+    std::uintptr_t word = 0;
+
+    static const std::intptr_t inline_min = INTPTR_MIN / 2;
+    static const std::intptr_t inline_max = INTPTR_MAX / 2;
+
+    bool is_inline() const { return word & 1; }
+    bool is_cell() const { return word != 0 && !(word & 1); }
+    Node * node() const { return reinterpret_cast<Node *>( word ); }
+
+    /* Takes ownership of one reference to the node. */
+    explicit Variable( Node * node ) : word( reinterpret_cast<std::uintptr_t>(node) ) {}
+
+    /* Removes an unreferenced node from the hash-consing table
+     * and frees it, releasing its children. */
+    static void destroy( Node * );
 
-    /* Move-constructs first and second. */
-    Variable( std::unique_ptr<Variable>&& f, std::unique_ptr<Variable>&& s );
+    /* Retrieves the unique cell for an integer that does not fit inline. */
+    static Node * box( long long value );
 
-    /* Set first = nullptr and initializes value. */
-    explicit Variable( long long value );
+    friend class VariableStore;
+    friend class VariablePool;
+    friend bool operator==( const Variable&, const Variable& );
 
-    /* The destructor is not the default because we have a union
-     * and we must call the destructor of second conditionally. */
+public:
+    /* Mixing function used to hash integers. */
+    static std::size_t mix( std::size_t h ) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /* Constructs a null variable. */
+    Variable() = default;
+
+    /* Stores the integer inline, or retrieves its unique cell. */
+    explicit Variable( long long value ) :
+        word( value >= inline_min && value <= inline_max ?
+                static_cast<std::uintptr_t>(value) << 1 | 1 :
+                reinterpret_cast<std::uintptr_t>( box(value) ) )
+    {}
+
+    /* Retrieves the unique cell for the pair {first, second}. */
+    Variable( const Variable& first, const Variable& second );
+
+    /* Copies share the cell; moves leave the source null. */
+    Variable( const Variable& );
+    Variable( Variable&& other ) noexcept : word( other.word ) {
+        other.word = 0;
+    }
+    Variable& operator=( const Variable& );
+    Variable& operator=( Variable&& ) noexcept;
     ~Variable();
 
-    /* Due to the complexity added by the union, it is easier
-     * to simply disallow copies, moves and assignments. */
-    Variable( const Variable & ) = delete;
-    Variable( Variable && ) = delete;
-    Variable & operator=( const Variable & ) = delete;
-    Variable & operator=( Variable && ) = delete;
+    explicit operator bool() const { return word != 0; }
+
+    bool is_pair() const;
+
+    /* Valid only if !is_pair(). */
+    long long value() const;
 
-    /* Returns a deep copy of this object. */
-    std::unique_ptr<Variable> clone() const;
+    /* Valid only if is_pair(). */
+    const Variable& first() const;
+    const Variable& second() const;
+
+    /* Structural hash of the value. */
+    std::size_t hash() const;
 };
 
-/* Returns true if the objects are of the same type
- * and share the same value, false otherwise. */
-bool operator==( const Variable& lhs, const Variable& rhs );
+/* Returns true if the objects are of the same type and share
+ * the same value, false otherwise.
+ * Due to hash-consing, this is a comparison of the handles. */
+inline bool operator==( const Variable& lhs, const Variable& rhs ) {
+    return lhs.word == rhs.word;
+}
+inline bool operator!=( const Variable& lhs, const Variable& rhs ) {
+    return !(lhs == rhs);
+}
 
 /* Prints the variable to the specified output stream. */
 std::ostream & operator<<( std::ostream&, const Variable& );
 
-/* Class that mantains a list of variables and its names.
- * It is used in variable decomposition, done during overload selection. */
-class VariableTable {
-    std::unordered_map< std::string, std::unique_ptr<Variable> > table;
+/* Activation frame of an overload: the values bound to its pattern
+ * variables, indexed by the slots assigned during semantic analysis
+ * (see VariableList in symbol_table.h).
+ * It is filled by variable decomposition, done during overload selection.
+ *
+ * The frame does not own the values: each slot borrows a reference to
+ * the argument of the call, or to some subtree of it. Thus, binding
+ * copies nothing, and the arguments must outlive the frame.
+ *
+ * Frames with up to inline_slots slots need no heap allocation. */
+class Frame {
+    static const unsigned inline_slots = 8;
+    const Variable * inline_storage[inline_slots] = {};
+    std::unique_ptr<const Variable *[]> heap_storage;
+    const Variable ** slots;
+
+public:
+    /* Constructs a frame with the given number of unbound slots. */
+    explicit Frame( unsigned size = 0 ) :
+        heap_storage( size > inline_slots ? new const Variable *[size]() : nullptr ),
+        slots( size > inline_slots ? heap_storage.get() : inline_storage )
+    {}
+
+    Frame( const Frame& ) = delete;
+    Frame & operator=( const Frame& ) = delete;
+
+    /* Unbinds every slot and resizes the frame, so that it
+     * can be reused by another call. */
+    void reset( unsigned size ) {
+        if( size > inline_slots ) {
+            heap_storage.reset( new const Variable *[size]() );
+            slots = heap_storage.get();
+        }
+        else {
+            std::fill( inline_storage, inline_storage + size, nullptr );
+            slots = inline_storage;
+        }
+    }
+
+    /* Binds a variable to the slot.
+     * If the slot is already bound and the stored value is the
+     * same, this method silently ignores the binding.
+     * Returns false if the slot is bound to a different value. */
+    bool bind( unsigned slot, const Variable& variable ) {
+        if( !slots[slot] )
+            slots[slot] = &variable;
+        return *slots[slot] == variable;
+    }
+
+    /* Returns the variable bound to the slot. */
+    const Variable& operator[]( unsigned slot ) const {
+        return *slots[slot];
+    }
+};
+
+/* Arena that backs every Variable created during its lifetime.
+ *
+ * Pools are scoped: constructing a pool makes it the active one, and
+ * destroying it reactivates the enclosing pool (or the heap).
+ * Pools shall be destroyed in the reverse order of construction.
+ *
+ * Cells allocated in a pool are never freed individually; the whole
+ * arena is released when the pool is destroyed. Therefore, no Variable
+ * that refers to the pool may outlive it; use copy_out to keep a value
+ * past the end of the pool. */
+class VariablePool {
+    VariableStore * store;
+
+public:
+    VariablePool();
+    ~VariablePool();
+
+    VariablePool( const VariablePool& ) = delete;
+    VariablePool& operator=( const VariablePool& ) = delete;
+
+    /* Returns a copy of the variable that does not depend on this pool.
+     * The copy is allocated in the enclosing pool, or on the heap. */
+    Variable copy_out( const Variable& ) const;
+
+    /* Function called by every pool right before its cells are released.
+     * Caches that may hold variables from pools use it to drop them
+     * (see call_cache.h). */
+    static void (*on_release)();
+};
+
+/* Stores of the two branches of a parallel evaluation
+ * (see task_scheduler.h).
+ *
+ * Constructing a fork freezes the active store: from then on, new cells
+ * are created in one of two branch stores, children of the frozen one,
+ * and the frozen store is only read until the fork is joined. Thus, two
+ * threads may evaluate the branches, each one in its own store, while
+ * both read the values created before the fork.
+ * The thread that constructs the fork enters the first branch; another
+ * thread enters the second branch through a Branch object.
+ *
+ * The branches do not see each other's cells, so a value created in both
+ * exists twice. Joining copies the results of both branches to the frozen
+ * store, where they are unique again, and makes that store active.
+ * The branches are released when the fork is destroyed; no variable
+ * created in them may outlive the fork, except through join.
+ *
+ * Forks shall be destroyed in the reverse order of construction,
+ * by the thread that constructed them. */
+class VariableFork {
+    VariableStore * base;
+    VariableStore * branches[2];
 
 public:
-    /* Inserts a variable in the table.
-     * If the variable exists in the table and the stored value is the
-     * same, this method silently ignores the insertion.
-     * Otherwise, semantic_error is thrown. */
-    void insert( std::string name, std::unique_ptr<Variable>&& variable );
-
-    /* Returns a clone of the specified variable. */
-    std::unique_ptr<Variable> retrieve( std::string name ) const;
+    VariableFork();
+    ~VariableFork();
+
+    VariableFork( const VariableFork& ) = delete;
+    VariableFork& operator=( const VariableFork& ) = delete;
+
+    /* Makes the second branch the active store of the calling thread
+     * during the lifetime of the object. */
+    class Branch {
+        VariableStore * previous;
+    public:
+        explicit Branch( VariableFork & );
+        ~Branch();
+        Branch( const Branch& ) = delete;
+        Branch& operator=( const Branch& ) = delete;
+    };
+
+    /* Returns copies of the results of the first and the second branch
+     * allocated in the frozen store, that becomes active again.
+     * Both branches must have finished. */
+    std::pair<Variable, Variable> join( const Variable& first, const Variable& second );
+};
+
+/* Implementation details.
+ * Cells are only created and destroyed inside variable.cpp;
+ * the definition is here only to allow the accessors to be inlined. */
+struct Variable::Node {
+    std::atomic<std::size_t> references; // Used only if 'counted'.
+    std::size_t hash;
+    Node * next; // Next cell in the same hash-consing bucket.
+    VariableStore * store; // Heap or pool that owns this cell.
+    bool counted; // True for heap cells.
+    bool pair;
+    long long value; // active if !pair
+    Variable first, second; // active if pair
 };
+
+inline bool Variable::is_pair() const {
+    return !is_inline() && node()->pair;
+}
+inline long long Variable::value() const {
+    if( is_inline() )
+        return static_cast<std::intptr_t>( word ) >> 1;
+    return node()->value;
+}
+inline const Variable& Variable::first() const {
+    return node()->first;
+}
+inline const Variable& Variable::second() const {
+    return node()->second;
+}
+inline std::size_t Variable::hash() const {
+    if( is_inline() )
+        return mix( value() );
+    return node()->hash;
+}
+
+inline Variable::Variable( const Variable& other ) : word( other.word ) {
+    if( is_cell() && node()->counted )
+        node()->references.fetch_add( 1, std::memory_order_relaxed );
+}
+inline Variable::~Variable() {
+    if( is_cell() && node()->counted &&
+            node()->references.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+        destroy( node() );
+}
+inline Variable& Variable::operator=( const Variable& other ) {
+    Variable tmp( other );
+    return *this = std::move( tmp );
+}
+inline Variable& Variable::operator=( Variable&& other ) noexcept {
+    std::swap( word, other.word );
+    return *this;
+}
+
 #endif // VARIABLE_H
@@ -0,0 +1,240 @@
+/* virtual_machine.cpp
+ * Implementation of virtual_machine.h
+ */
+#include <utility>
+#include "call_cache.h"
+#include "exceptions.h"
+#include "virtual_machine.h"
+
+namespace {
+    /* Candidates of the operators with a single overload;
+     * the index would be of no use for them. */
+    const std::vector<unsigned> single_overload{ 0 };
+} // anonymous namespace
+
+VirtualMachine::VirtualMachine( const Bytecode & program, std::size_t budget ) :
+    program( program ),
+    budget( budget )
+{}
+
+Variable VirtualMachine::run() {
+    chunk = used = 0;
+    if( stack.empty() )
+        stack.emplace_back();
+    Activation * a = &stack.front();
+    a->caller = nullptr;
+    a->op = &program.operators[0];
+    a = enter( *a );
+    for( ;; ) try {
+        for( ;; ) {
+            const Instruction & instruction = *a->pc;
+            Variable value;
+            switch( instruction.opcode ) {
+                case Instruction::pair:
+                    value = Variable( a->frame[instruction.left], a->frame[instruction.right] );
+                    break;
+                case Instruction::call0:
+                case Instruction::call1:
+                case Instruction::call2:
+                    if( CallCache::active )
+                        if( const Variable * cached = lookup( *a, instruction ) ) {
+                            value = *cached;
+                            break;
+                        }
+                    a = call( *a, instruction );
+                    continue;
+                case Instruction::native:
+                    value = program.natives[instruction.operand]->evaluate( a->frame );
+                    break;
+                case Instruction::apply: {
+                    const Variable & left = a->frame[instruction.left];
+                    const Variable & right = a->frame[instruction.right];
+                    if( left.is_pair() || right.is_pair() )
+                        throw semantic_error( "No valid overload found" );
+                    value = Variable( program.arithmetic[instruction.operand]
+                            ->apply( left.value(), right.value() ) );
+                    break;
+                }
+                case Instruction::ret:
+                    value = a->frame[instruction.left];
+                    break;
+            }
+
+            /* The value is the result of a body, and of every call
+             * that returns that body's result unchanged. */
+            while( a->pc->dest == Instruction::result )
+                if( !(a = finish( *a, value )) )
+                    return value;
+            a->temporaries[a->pc->dest] = std::move( value );
+            ++a->pc;
+        }
+    } catch( semantic_error & ) {
+        // Found invalid overload.
+        a = fail( a );
+    }
+}
+
+VirtualMachine::Activation & VirtualMachine::push( Activation & caller, unsigned op ) {
+    if( !caller.callee ) {
+        stack.emplace_back();
+        caller.callee = &stack.back();
+        caller.callee->caller = &caller;
+    }
+    caller.callee->op = &program.operators[op];
+    return *caller.callee;
+}
+
+void VirtualMachine::pop( Activation & a ) {
+    release( a );
+    if( a.owned[0] )
+        a.owned[0] = Variable();
+    if( a.owned[1] )
+        a.owned[1] = Variable();
+}
+
+/* Selects the candidate overloads for the arguments of the activation
+ * and starts the first valid one. Returns the activation to run next. */
+VirtualMachine::Activation * VirtualMachine::enter( Activation & a ) {
+    if( budget-- == 0 )
+        throw budget_exceeded();
+    a.next = 0;
+    if( a.op->bodies.size() == 1 )
+        a.candidates = &single_overload;
+    else switch( a.op->arity ) {
+        case 0:
+            a.candidates = &static_cast<const NullaryOperator *>( a.op->op )->candidates();
+            break;
+        case 1:
+            a.candidates = &static_cast<const UnaryOperator *>( a.op->op )
+                ->candidates( *a.args[0] );
+            break;
+        case 2:
+            a.candidates = &static_cast<const BinaryOperator *>( a.op->op )
+                ->candidates( *a.args[0], *a.args[1] );
+            break;
+    }
+    if( start( a ) )
+        return &a;
+    return fail( &a );
+}
+
+/* Starts the first overload, from the position a.next on, whose
+ * pattern matches the arguments. Returns false if there is none. */
+bool VirtualMachine::start( Activation & a ) {
+    for( ; a.next < a.candidates->size(); ++a.next ) {
+        unsigned overload = (*a.candidates)[a.next];
+        const CompiledBody & body = a.op->bodies[overload];
+        a.frame.reset( body.registers() );
+        if( !match( a, overload ) )
+            continue;
+
+        a.body = &body;
+        a.mark = Mark{ chunk, used };
+        if( used + body.temporaries > chunk_size ) {
+            ++chunk;
+            used = 0;
+        }
+        if( chunk == chunks.size() )
+            chunks.emplace_back( new Variable[chunk_size] );
+        a.temporaries = &chunks[chunk][used];
+        used += body.temporaries;
+
+        unsigned reg = body.slots;
+        for( unsigned i = 0; i < body.temporaries; ++i )
+            a.frame.bind( reg++, a.temporaries[i] );
+        const unsigned * constants = program.constants.data() + body.constants;
+        for( unsigned i = 0; i < body.constant_count; ++i )
+            a.frame.bind( reg++, program.values[constants[i]] );
+
+        a.pc = program.code.data() + body.entry;
+        return true;
+    }
+    return false;
+}
+
+bool VirtualMachine::match( Activation & a, unsigned overload ) {
+    switch( a.op->arity ) {
+        case 1:
+            return static_cast<const UnaryOperator *>( a.op->op )
+                ->overloads[overload]->match( a.frame, *a.args[0] );
+        case 2:
+            return static_cast<const BinaryOperator *>( a.op->op )
+                ->overloads[overload]->match( a.frame, *a.args[0], *a.args[1] );
+        default:
+            return true;
+    }
+}
+
+/* Releases the temporaries of the running overload. */
+void VirtualMachine::release( Activation & a ) {
+    if( !a.body )
+        return;
+    for( unsigned i = 0; i < a.body->temporaries; ++i )
+        a.temporaries[i] = Variable();
+    chunk = a.mark.chunk;
+    used = a.mark.used;
+    a.body = nullptr;
+}
+
+/* Executes the call instruction of the activation.
+ * Returns the activation to run next. */
+VirtualMachine::Activation * VirtualMachine::call( Activation & a, const Instruction & instruction ) {
+    const CompiledOperator & op = program.operators[instruction.operand];
+    bool tail = instruction.dest == Instruction::result &&
+        a.next + 1 == a.candidates->size() && !CallCache::active;
+
+    if( !tail ) {
+        Activation & callee = push( a, instruction.operand );
+        if( op.arity > 0 )
+            callee.args[0] = &a.frame[instruction.left];
+        if( op.arity > 1 )
+            callee.args[1] = &a.frame[instruction.right];
+        return enter( callee );
+    }
+
+    /* The arguments might be in the registers of the caller,
+     * that are released before the callee starts. */
+    Variable left = op.arity > 0 ? a.frame[instruction.left] : Variable();
+    Variable right = op.arity > 1 ? a.frame[instruction.right] : Variable();
+    release( a );
+    a.op = &op;
+    a.owned[0] = std::move( left );
+    a.owned[1] = std::move( right );
+    a.args[0] = &a.owned[0];
+    a.args[1] = &a.owned[1];
+    return enter( a );
+}
+
+/* Returns the cached result of the call instruction, or nullptr. */
+const Variable * VirtualMachine::lookup( const Activation & a, const Instruction & instruction ) {
+    const CompiledOperator & op = program.operators[instruction.operand];
+    if( op.arity == 0 )
+        return nullptr;
+    return CallCache::active->lookup( *op.op, a.frame[instruction.left],
+            op.arity > 1 ? a.frame[instruction.right] : Variable() );
+}
+
+/* Pops the activation, that returned the result.
+ * Returns the caller, or nullptr if the program has ended. */
+VirtualMachine::Activation * VirtualMachine::finish( Activation & a, const Variable & result ) {
+    if( CallCache::active && a.op->arity > 0 )
+        CallCache::active->record( *a.op->op, *a.args[0],
+                a.op->arity > 1 ? *a.args[1] : Variable(), result );
+    pop( a );
+    return a.caller;
+}
+
+/* Handles the failure of the body of the activation, the topmost one:
+ * the activations that have no other candidate overload are popped,
+ * and the next overload of the remaining one is started.
+ * Returns that activation; throws semantic_error if there is none. */
+VirtualMachine::Activation * VirtualMachine::fail( Activation * a ) {
+    for( ; a; a = a->caller ) {
+        release( *a );
+        ++a->next;
+        if( start( *a ) )
+            return a;
+        pop( *a );
+    }
+    throw semantic_error( "No valid overload found" );
+}
@@ -0,0 +1,115 @@
+/* virtual_machine.h
+ * Register machine that executes the code produced by compileProgram.
+ *
+ * This is the evaluator used to run programs; the method 'evaluate' of
+ * the operator bodies (the tree walker) gives the same results, and is
+ * kept as a reference.
+ *
+ * Every operator call selects the overload exactly as OperatorBase does:
+ * the candidates are tried in insertion order, and an overload whose
+ * body raises a semantic_error is considered invalid.
+ *
+ * Operator calls do not use the C++ stack: each call pushes an
+ * Activation on a stack kept by the machine, and the machine runs
+ * the instructions of the topmost activation. Thus, the depth of the
+ * recursion is bounded by the available memory, not by the size of
+ * the thread stack. When a body fails, its activation moves on to the
+ * next candidate overload; if there is none left, the activation is
+ * popped and the body of the caller fails in turn.
+ *
+ * A call whose result is returned by the caller (a tail call) reuses
+ * the activation of the caller, provided that the caller has no other
+ * candidate overload left to try; otherwise, a failure of the callee
+ * would have to resume the caller. Tail recursive operators, like
+ *
+ *  X + Y
+ *      ++ X + -- Y
+ *
+ * run in constant space. Tail calls are not eliminated while
+ * memoizing, since the result of every call is cached on return.
+ *
+ * The registers of each body live in the Frame of its activation:
+ * the frame borrows the arguments of the call, the temporaries of the
+ * body and the constants of the program, all owned by the machine.
+ * Arguments are passed to other operators without being copied, except
+ * in tail calls, where the registers of the caller are released before
+ * the callee runs.
+ *
+ * The temporaries are allocated as a stack, in chunks, so that their
+ * addresses never change; unused temporaries are null.
+ */
+#ifndef VIRTUAL_MACHINE_H
+#define VIRTUAL_MACHINE_H
+
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "bytecode.h"
+#include "variable.h"
+
+class VirtualMachine {
+    /* Position in the stack of temporaries. */
+    struct Mark {
+        unsigned chunk;
+        unsigned used;
+    };
+
+    struct Activation {
+        Activation * caller;
+        Activation * callee = nullptr; // The activation reused by the next call.
+
+        const CompiledOperator * op;
+        const Variable * args[2];
+        Variable owned[2]; // Arguments of a tail call.
+
+        const std::vector<unsigned> * candidates;
+        unsigned next; // Position of the running overload in 'candidates'.
+
+        /* State of the running overload; 'body' is null if none. */
+        const CompiledBody * body = nullptr;
+        const Instruction * pc;
+        Frame frame;
+        Variable * temporaries;
+        Mark mark; // Top of the stack of temporaries before this body.
+    };
+
+    const Bytecode & program;
+    std::size_t budget; // Operator calls left.
+
+    /* Activations are never destroyed, only reused, and a deque
+     * never moves its elements; so the arguments borrowed from
+     * 'owned' stay valid. */
+    std::deque<Activation> stack;
+
+    static const unsigned chunk_size = 1 << 16; // Enough for any body.
+    std::vector<std::unique_ptr<Variable[]>> chunks;
+    unsigned chunk = 0; // Chunk of the next free temporary.
+    unsigned used = 0;  // Temporaries in use in that chunk.
+
+    Activation & push( Activation & caller, unsigned op );
+    void pop( Activation & );
+
+    Activation * enter( Activation & );
+    bool start( Activation & );
+    bool match( Activation &, unsigned overload );
+    void release( Activation & );
+
+    Activation * call( Activation &, const Instruction & );
+    const Variable * lookup( const Activation &, const Instruction & );
+    Activation * finish( Activation &, const Variable & result );
+    Activation * fail( Activation * );
+
+public:
+    /* The program shall outlive the machine.
+     * Each operator call consumes one step of the budget;
+     * when it is exhausted, 'run' throws budget_exceeded. */
+    explicit VirtualMachine( const Bytecode & program,
+            std::size_t budget = std::numeric_limits<std::size_t>::max() );
+
+    /* Evaluates the entry point of the program. */
+    Variable run();
+};
+
+#endif // VIRTUAL_MACHINE_H